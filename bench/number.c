@@ -0,0 +1,122 @@
+/*
+Compares formatting of numbers by `number_format` with printf's "%f" and
+"%.17g", which round-trips too. Prints seconds per `BENCH_COUNT` formats of
+random doubles and of integers.
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "number.h"
+
+#define BENCH_COUNT (1000000)
+
+/* "%f" of the largest double takes 309 digits before the point */
+#define BENCH_BUFFER_SIZE (512)
+
+typedef enum {
+	BENCH_NUMBER,
+	BENCH_PRINTF_F,
+	BENCH_PRINTF_G
+} BenchFormat;
+
+static double bench_double(uint64_t *state);
+static double bench_integer(uint64_t *state);
+static void bench_run(const char *name, double (*next)(uint64_t *));
+static double bench_time(
+	double (*next)(uint64_t *),
+	BenchFormat format,
+	size_t *length
+);
+static uint64_t bench_xorshift(uint64_t *state);
+
+int
+main(void)
+{
+	printf("%-8s %10s %10s %10s\n", "input", "number", "%f", "%.17g");
+	bench_run("doubles", bench_double);
+	bench_run("integers", bench_integer);
+	return 0;
+}
+
+/* Random finite double: half are random bit patterns, half short fractions. */
+static double
+bench_double(uint64_t *state)
+{
+	uint64_t bits = bench_xorshift(state);
+	double rv;
+
+	if (bits & 1)
+		return (double)(bits >> 44) / 1000.0;
+
+	/* Exponent of all ones is infinity or NaN */
+	memcpy(&rv, &bits, sizeof(double));
+	if (rv != rv || rv - rv != 0)
+		return 0.5;
+	return rv;
+}
+
+/* Random integer exactly representable by double. */
+static double
+bench_integer(uint64_t *state)
+{
+	return (double)(bench_xorshift(state) >> 11);
+}
+
+/* Prints timings of all formats for numbers produced by `next`. */
+static void
+bench_run(const char *name, double (*next)(uint64_t *))
+{
+	size_t length = 0;
+	double number = bench_time(next, BENCH_NUMBER, &length),
+		printf_f = bench_time(next, BENCH_PRINTF_F, &length),
+		printf_g = bench_time(next, BENCH_PRINTF_G, &length);
+
+	printf("%-8s %10.3f %10.3f %10.3f\n", name, number, printf_f, printf_g);
+
+	/* Keeps formatting from being optimized out */
+	if (length == 0)
+		printf("nothing formatted\n");
+}
+
+/*
+Formats `BENCH_COUNT` numbers produced by `next` in `format`. Adds lengths of
+the formatted numbers to `length`. Returns seconds spent.
+*/
+static double
+bench_time(double (*next)(uint64_t *), BenchFormat format, size_t *length)
+{
+	size_t i;
+	uint64_t state = 88172645463325252u;
+	char buffer[BENCH_BUFFER_SIZE];
+	clock_t start = clock();
+
+	for (i = 0; i < BENCH_COUNT; ++i) {
+		switch (format) {
+		case BENCH_NUMBER:
+			*length += number_format(next(&state), buffer);
+			break;
+		case BENCH_PRINTF_F:
+			*length += snprintf(buffer, BENCH_BUFFER_SIZE, "%f", next(&state));
+			break;
+		case BENCH_PRINTF_G:
+			*length += snprintf(
+				buffer,
+				BENCH_BUFFER_SIZE,
+				"%.17g",
+				next(&state)
+			);
+			break;
+		}
+	}
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static uint64_t
+bench_xorshift(uint64_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 7;
+	*state ^= *state << 17;
+	return *state;
+}
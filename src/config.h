@@ -1,7 +1,30 @@
 #ifndef _CONFIG_H
 #define _CONFIG_H
 
-#define ENV_ENTRY_KEY_HASH_MODULO (101)
+#define ENV_BUILTINS_TABLE_SIZE (256)
+#define ENV_SLOTS_MIN_COUNT (256)
 #define ERROR_BUFFER_SIZE (512)
+#define HAMT_BITS (5)
+#define HASHCONS_MIN_SIZE (256)
+#define MEMO_DEFAULT_CAPACITY (1024)
+#define MEMO_MIN_BUCKETS_COUNT (16)
+#define OPTIMIZE_INLINE_MAX_DEPTH (4)
+#define OPTIMIZE_INLINE_MAX_SIZE (16)
+#define OUTPUT_BUFFER_SIZE (65536)
+#define POOL_ARENA_SIZE (1048576)
+#define POOL_FORWARDS_MIN_SIZE (256)
+#define POOL_GRANULARITY (16)
+#define POOL_MAX_SIZE (256)
+#define POOL_SLAB_SIZE (65536)
+#define PVECTOR_BITS (5)
+#define PVECTOR_EXTRAS (2)
+#define VALUE_COUNTER_MAX (9007199254740992.0)
+#define VALUE_ESCAPES_MIN_CAPACITY (64)
+#define VALUE_FRAMES_MIN_CAPACITY (16)
+#define VALUE_HASH_MIN_SIZE (32)
+#define VALUE_SITE_MAX_DEOPTS (4)
+#define VALUE_STACK_SEGMENT_SIZE (4096)
+#define VALUE_TASKS_MIN_CAPACITY (64)
+#define VECTOR_MIN_CAPACITY (8)
 
 #endif /* _CONFIG_H */
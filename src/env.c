@@ -1,113 +1,384 @@
 #include <stdlib.h>
 #include "env.h"
+#include "pool.h"
 #include "utils.h"
 
-static EnvEntry *env_entry_alloc(const char *symbol, const Value *value);
-static EnvEntry *env_entry_copy(const EnvEntry *entry);
+/*
+Perfect hash of builtin symbols by length, first, last and third from the end
+characters. Symbols shorter than three characters use the first character as
+the third from the end. Collision is reported at compile time as overridden
+initializer of `env_builtins`.
+*/
+#define ENV_BUILTIN_HASH(length, first, last, third_last) \
+	(((length) + (first) + (last) * 11 + (third_last) * 7) \
+		% ENV_BUILTINS_TABLE_SIZE)
+
+typedef struct EnvBuiltin {
+	const char *symbol;
+	ValueBuiltin builtin;
+} EnvBuiltin;
+
+static EnvEntry *env_entry_alloc(const Env *env, size_t slot, Value *value);
 static void env_entry_free(EnvEntry *entry);
-static size_t env_entry_hash_key(const Value *key);
+static EnvEntry *env_entry_promote(EnvEntry *entry);
 static EnvEntry *env_lookup(const Env *env, const Value *key);
+static void env_symbols_grow(void);
+static size_t env_symbols_hash(const char *symbol);
 static void env_set_builtin(
 	Env *env,
 	const char *symbol,
 	ValueBuiltin builtin
 );
 
+static const EnvBuiltin env_builtins[ENV_BUILTINS_TABLE_SIZE] = {
+	[ENV_BUILTIN_HASH(1, '=', '=', '=')] = {"=", value_symbol_set_eval},
+	[ENV_BUILTIN_HASH(1, '+', '+', '+')] = {"+", value_symbol_add_eval},
+	[ENV_BUILTIN_HASH(1, '-', '-', '-')] = {"-", value_symbol_substract_eval},
+	[ENV_BUILTIN_HASH(1, '*', '*', '*')] = {"*", value_symbol_multiply_eval},
+	[ENV_BUILTIN_HASH(1, '/', '/', '/')] = {"/", value_symbol_divide_eval},
+	[ENV_BUILTIN_HASH(2, '=', '=', '=')] = {"==", value_symbol_eq_eval},
+	[ENV_BUILTIN_HASH(2, '!', '=', '!')] = {"!=", value_symbol_ne_eval},
+	[ENV_BUILTIN_HASH(1, '>', '>', '>')] = {">", value_symbol_gt_eval},
+	[ENV_BUILTIN_HASH(2, '>', '=', '>')] = {">=", value_symbol_ge_eval},
+	[ENV_BUILTIN_HASH(1, '<', '<', '<')] = {"<", value_symbol_lt_eval},
+	[ENV_BUILTIN_HASH(2, '<', '=', '<')] = {"<=", value_symbol_le_eval},
+	[ENV_BUILTIN_HASH(1, '!', '!', '!')] = {"!", value_symbol_not_eval},
+	[ENV_BUILTIN_HASH(2, '|', '|', '|')] = {"||", value_symbol_or_eval},
+	[ENV_BUILTIN_HASH(2, '&', '&', '&')] = {"&&", value_symbol_and_eval},
+	[ENV_BUILTIN_HASH(1, '\\', '\\', '\\')] = {"\\", value_symbol_lambda_eval},
+	[ENV_BUILTIN_HASH(3, 'd', 'f', 'd')] = {"def", value_symbol_def_eval},
+	[ENV_BUILTIN_HASH(9, 'd', 'd', 'o')] = {"defrecord", value_symbol_defrecord_eval},
+	[ENV_BUILTIN_HASH(5, 'e', 'r', 'r')] = {"error", value_symbol_error_eval},
+	[ENV_BUILTIN_HASH(4, 'e', 'l', 'v')] = {"eval", value_symbol_eval_eval},
+	[ENV_BUILTIN_HASH(4, 'h', 'd', 'e')] = {"head", value_symbol_head_eval},
+	[ENV_BUILTIN_HASH(2, 'i', 'f', 'i')] = {"if", value_symbol_if_eval},
+	[ENV_BUILTIN_HASH(5, 'w', 'e', 'i')] = {"while", value_symbol_while_eval},
+	[ENV_BUILTIN_HASH(5, 'i', 't', 'p')] = {"input", value_symbol_input_eval},
+	[ENV_BUILTIN_HASH(4, 'j', 'n', 'o')] = {"join", value_symbol_join_eval},
+	[ENV_BUILTIN_HASH(4, 'l', 't', 'i')] = {"list", value_symbol_list_eval},
+	[ENV_BUILTIN_HASH(4, 'l', 'd', 'o')] = {"load", value_symbol_load_eval},
+	[ENV_BUILTIN_HASH(4, 'm', 'o', 'e')] = {"memo", value_symbol_memo_eval},
+	[ENV_BUILTIN_HASH(10, 'm', 's', 'a')] = {"memo-stats", value_symbol_memo_stats_eval},
+	[ENV_BUILTIN_HASH(5, 'p', 't', 'i')] = {"print", value_symbol_print_eval},
+	[ENV_BUILTIN_HASH(14, 'n', 'g', 'i')] = {"number->string", value_symbol_number_to_string_eval},
+	[ENV_BUILTIN_HASH(4, 't', 'l', 'a')] = {"tail", value_symbol_tail_eval},
+	[ENV_BUILTIN_HASH(2, 'd', 'o', 'd')] = {"do", value_symbol_do_eval},
+	[ENV_BUILTIN_HASH(3, 'l', 't', 'l')] = {"let", value_symbol_let_eval},
+	[ENV_BUILTIN_HASH(6, 's', 't', 'e')] = {"select", value_symbol_select_eval},
+	[ENV_BUILTIN_HASH(4, 'c', 'e', 'a')] = {"case", value_symbol_case_eval},
+	[ENV_BUILTIN_HASH(4, 'p', 'k', 'a')] = {"pack", value_symbol_pack_eval},
+	[ENV_BUILTIN_HASH(6, 'u', 'k', 'a')] = {"unpack", value_symbol_unpack_eval},
+	[ENV_BUILTIN_HASH(3, 'f', 'r', 'f')] = {"for", value_symbol_for_eval},
+	[ENV_BUILTIN_HASH(7, 'd', 's', 'm')] = {"dotimes", value_symbol_dotimes_eval},
+	[ENV_BUILTIN_HASH(6, 'v', 'r', 't')] = {"vector", value_symbol_vector_eval},
+	[ENV_BUILTIN_HASH(10, 'v', 't', 'g')] = {"vector-get", value_symbol_vector_get_eval},
+	[ENV_BUILTIN_HASH(11, 'v', '!', 'e')] = {"vector-set!", value_symbol_vector_set_eval},
+	[ENV_BUILTIN_HASH(12, 'v', '!', 's')] = {"vector-push!", value_symbol_vector_push_eval},
+	[ENV_BUILTIN_HASH(10, 'v', 'n', 'l')] = {"vector-len", value_symbol_vector_len_eval},
+	[ENV_BUILTIN_HASH(4, 'p', 'c', 'v')] = {"pvec", value_symbol_pvec_eval},
+	[ENV_BUILTIN_HASH(8, 'p', 'h', 'n')] = {"pvec-nth", value_symbol_pvec_nth_eval},
+	[ENV_BUILTIN_HASH(10, 'p', 'c', 's')] = {"pvec-assoc", value_symbol_pvec_assoc_eval},
+	[ENV_BUILTIN_HASH(9, 'p', 'j', 'o')] = {"pvec-conj", value_symbol_pvec_conj_eval},
+	[ENV_BUILTIN_HASH(11, 'p', 't', 'c')] = {"pvec-concat", value_symbol_pvec_concat_eval},
+	[ENV_BUILTIN_HASH(8, 'p', 'n', 'l')] = {"pvec-len", value_symbol_pvec_len_eval},
+	[ENV_BUILTIN_HASH(7, 'm', 'w', 'n')] = {"map-new", value_symbol_map_new_eval},
+	[ENV_BUILTIN_HASH(7, 'm', 't', 'g')] = {"map-get", value_symbol_map_get_eval},
+	[ENV_BUILTIN_HASH(7, 'm', 't', 'p')] = {"map-put", value_symbol_map_put_eval},
+	[ENV_BUILTIN_HASH(10, 'm', 'e', 'o')] = {"map-remove", value_symbol_map_remove_eval},
+	[ENV_BUILTIN_HASH(8, 'm', 's', 'e')] = {"map-keys", value_symbol_map_keys_eval},
+	[ENV_BUILTIN_HASH(8, 'm', 'e', 'i')] = {"map-size", value_symbol_map_size_eval},
+};
+
+/*
+Interned symbols. Index of a symbol is its slot in the global env.
+
+Table is open addressed and stores indexes increased by one, zero is empty.
+*/
+static char **env_symbols = NULL;
+static size_t env_symbols_count = 0;
+static size_t *env_symbols_table = NULL;
+static size_t env_symbols_table_size = 0;
+
+/* Allocates frame with place for `size` bindings. */
 Env*
-env_alloc(void)
+env_alloc(size_t size)
 {
-	size_t i;
-	Env *rv = malloc(sizeof(Env));
+	Env *rv = pool_alloc(sizeof(Env) + sizeof(EnvEntry) * size);
+	rv->size = size;
+	rv->refs = 1;
 	rv->parent = NULL;
-	for (i = 0; i < ENV_ENTRY_KEY_HASH_MODULO; ++i)
-		rv->entries[i] = NULL;
+	rv->loop = 0;
+	rv->slots = NULL;
+	rv->slots_count = 0;
+	rv->extra = NULL;
+	rv->count = 0;
 	return rv;
 }
 
+/*
+Allocates global env. Its entries are stored in a flat vector indexed by
+slots of interned symbols instead of hash table.
+*/
 Env*
-env_copy(const Env *env)
+env_alloc_global(void)
 {
-	size_t i;
-	Env *new_env = malloc(sizeof(Env));
-	new_env->parent = env->parent;
-	for (i = 0; i < ENV_ENTRY_KEY_HASH_MODULO; ++i) {
-		new_env->entries[i] = env->entries[i]
-			? env_entry_copy(env->entries[i])
-			: NULL;
-	}
-	return new_env;
+	Env *rv = env_alloc(0);
+	rv->slots = calloc(ENV_SLOTS_MIN_COUNT, sizeof(EnvEntry *));
+	rv->slots_count = ENV_SLOTS_MIN_COUNT;
+	return rv;
+}
+
+/* Allocates frame of loop counter in scope of `env`. */
+Env*
+env_alloc_loop(Env *env)
+{
+	Env *rv = env_alloc(1);
+	rv->parent = env_copy(env);
+	rv->loop = 1;
+	return rv;
+}
+
+/*
+Frees bindings of frame `env`, which stays allocated without them. Bindings
+are detached first, because freeing closures over `env` releases it.
+*/
+void
+env_clear(Env *env)
+{
+	size_t i,
+		count = env->count;
+	EnvEntry *extra = env->extra;
+
+	env->count = 0;
+	env->extra = NULL;
+	for (i = 0; i < count; ++i)
+		value_free(env->entries[i].value);
+	if (extra)
+		env_entry_free(extra);
+}
+
+/*
+Shares frame `env` with new owner. Global env outlives all values, so
+references to it are not counted.
+*/
+Env*
+env_copy(Env *env)
+{
+	if (!env->slots)
+		++env->refs;
+	return env;
 }
 
 void
 env_free(Env *env)
 {
 	size_t i;
-	for (i = 0; i < ENV_ENTRY_KEY_HASH_MODULO; ++i)
-		if (env->entries[i])
-			env_entry_free(env->entries[i]);
-	free(env);
+
+	for (i = 0; i < env->count; ++i)
+		value_free(env->entries[i].value);
+	if (env->extra)
+		env_entry_free(env->extra);
+
+	if (env->slots) {
+		for (i = 0; i < env->slots_count; ++i)
+			if (env->slots[i])
+				env_entry_free(env->slots[i]);
+		free(env->slots);
+	}
+	if (env->parent)
+		env_release(env->parent);
+	pool_free(env, sizeof(Env) + sizeof(EnvEntry) * env->size);
 }
 
+/* Resolves `key` in lexical scope of `env`. */
 Value*
 env_get(const Env *env, const Value *key)
 {
-	EnvEntry *entry = env_lookup(env, key);
-	if (entry)
-		return value_copy(entry->value);
-	else if (env->parent)
-		return env_get(env->parent, key);
+	EnvEntry *entry;
+
+	for (; env; env = env->parent) {
+		entry = env_lookup(env, key);
+		if (entry)
+			return value_copy(entry->value);
+	}
 	return value_error_alloc("Invalid symbol: %s.", key->symbol);
 }
 
-void
-env_set(Env *env, const Value *key, const Value *value)
+/*
+Returns builtin resolved by symbol `key` at read time if neither `env` chain
+shadows it nor the global was rebound. Otherwise returns NULL.
+*/
+ValueBuiltin
+env_get_builtin(const Env *env, const Value *key)
+{
+	EnvEntry *entry;
+
+	for (; env->parent; env = env->parent)
+		if (env_lookup(env, key))
+			return NULL;
+
+	entry = env_lookup(env, key);
+	if (
+		entry
+		&& entry->value->type == FUNCTION_TYPE
+		&& entry->value->builtin == key->builtin
+	)
+		return key->builtin;
+	return NULL;
+}
+
+/* Returns entry of `key` in root env if it's not shadowed by `env` chain. */
+EnvEntry*
+env_get_global_entry(const Env *env, const Value *key)
+{
+	EnvEntry *entry = env_lookup(env, key);
+	if (env->parent)
+		return entry ? NULL : env_get_global_entry(env->parent, key);
+	return entry;
+}
+
+/* Returns builtin named `symbol` or NULL. */
+ValueBuiltin
+env_builtin_lookup(const char *symbol)
+{
+	size_t length = strlen(symbol);
+	const EnvBuiltin *builtin;
+
+	if (length == 0)
+		return NULL;
+
+	builtin = &env_builtins[ENV_BUILTIN_HASH(
+		length,
+		(unsigned char)symbol[0],
+		(unsigned char)symbol[length - 1],
+		(unsigned char)symbol[length >= 3 ? length - 3 : 0]
+	)];
+	if (builtin->symbol && strcmp(builtin->symbol, symbol) == 0)
+		return builtin->builtin;
+	return NULL;
+}
+
+/* Returns slot of `symbol` in global env, interning it if needed. */
+size_t
+env_intern(const char *symbol)
+{
+	size_t i;
+
+	if (env_symbols_count * 2 >= env_symbols_table_size)
+		env_symbols_grow();
+
+	/* Find symbol or empty place for it */
+	i = env_symbols_hash(symbol) & (env_symbols_table_size - 1);
+	for (; env_symbols_table[i]; i = (i + 1) & (env_symbols_table_size - 1))
+		if (strcmp(env_symbols[env_symbols_table[i] - 1], symbol) == 0)
+			return env_symbols_table[i] - 1;
+
+	env_symbols[env_symbols_count] = strdup(symbol);
+	env_symbols_table[i] = ++env_symbols_count;
+	return env_symbols_count - 1;
+}
+
+/*
+Moves frame `env`, its bindings and ancestors out of arena once. Returns its
+new address. Global env is outside arena and its bindings are promoted when
+they are put.
+*/
+Env*
+env_promote(Env *env)
 {
-	size_t hash;
+	size_t i;
+	Env *rv = pool_forward(env);
+
+	if (rv)
+		return rv;
+	if (env->slots)
+		return env;
+	rv = pool_promote(env, sizeof(Env) + sizeof(EnvEntry) * env->size);
+	pool_forward_set(env, rv);
+
+	for (i = 0; i < rv->count; ++i)
+		rv->entries[i].value = value_promote(rv->entries[i].value);
+	if (rv->extra)
+		rv->extra = env_entry_promote(rv->extra);
+	if (rv->parent)
+		rv->parent = env_promote(rv->parent);
+	return rv;
+}
+
+/*
+Binds `value` to `key` in `env` and takes ownership of `value`. Returns entry
+of the binding, which stays in place while `env` lives. Global binding is
+recorded as an escape from arena.
+*/
+EnvEntry*
+env_put(Env *env, const Value *key, Value *value)
+{
+	size_t slots_count;
 	EnvEntry *entry = env_lookup(env, key);
 
 	if (entry) {
 		/* Free old value and set a new */
 		value_free(entry->value);
-		entry->value = value_copy(value);
+		entry->value = value;
+		++entry->version;
+	} else if (env->slots) {
+		/* Fit global slots */
+		if (key->slot >= env->slots_count) {
+			slots_count = env->slots_count;
+			while (key->slot >= env->slots_count)
+				env->slots_count *= 2;
+			env->slots = realloc(env->slots, sizeof(EnvEntry *) * env->slots_count);
+			for (; slots_count < env->slots_count; ++slots_count)
+				env->slots[slots_count] = NULL;
+		}
+		entry = env_entry_alloc(env, key->slot, value);
+		env->slots[key->slot] = entry;
+	} else if (env->count < env->size) {
+		/* Bind formal inline */
+		entry = &env->entries[env->count++];
+		entry->next = NULL;
+		entry->slot = key->slot;
+		entry->value = value;
+		entry->version = 0;
 	} else {
-		/* Create new entry */
-		hash = env_entry_hash_key(key);
-		entry = env_entry_alloc(key->symbol, value);
-		entry->next = env->entries[hash];
-		env->entries[hash] = entry;
+		/* Chain other local */
+		entry = env_entry_alloc(env, key->slot, value);
+		entry->next = env->extra;
+		env->extra = entry;
 	}
+
+	if (env->slots)
+		value_arena_escape(entry);
+	return entry;
+}
+
+/* Releases reference to frame `env` taken by `env_alloc` or `env_copy`. */
+void
+env_release(Env *env)
+{
+	if (!env->slots && --env->refs == 0)
+		env_free(env);
+}
+
+/*
+Binds copy of `value` to `key` in `env`. Loop frames are skipped unless `key`
+is their counter.
+*/
+void
+env_set(Env *env, const Value *key, const Value *value)
+{
+	while (env->loop && !env_lookup(env, key))
+		env = env->parent;
+	env_put(env, key, value_copy(value));
 }
 
 void
 env_set_builtins(Env *env)
 {
-	env_set_builtin(env, "=", value_symbol_set_eval);
-	env_set_builtin(env, "+", value_symbol_add_eval);
-	env_set_builtin(env, "-", value_symbol_substract_eval);
-	env_set_builtin(env, "*", value_symbol_multiply_eval);
-	env_set_builtin(env, "/", value_symbol_divide_eval);
-	env_set_builtin(env, "==", value_symbol_eq_eval);
-	env_set_builtin(env, "!=", value_symbol_ne_eval);
-	env_set_builtin(env, ">", value_symbol_gt_eval);
-	env_set_builtin(env, ">=", value_symbol_ge_eval);
-	env_set_builtin(env, "<", value_symbol_lt_eval);
-	env_set_builtin(env, "<=", value_symbol_le_eval);
-	env_set_builtin(env, "!", value_symbol_not_eval);
-	env_set_builtin(env, "||", value_symbol_or_eval);
-	env_set_builtin(env, "&&", value_symbol_and_eval);
-	env_set_builtin(env, "\\", value_symbol_lambda_eval);
-	env_set_builtin(env, "def", value_symbol_def_eval);
-	env_set_builtin(env, "error", value_symbol_error_eval);
-	env_set_builtin(env, "eval", value_symbol_eval_eval);
-	env_set_builtin(env, "head", value_symbol_head_eval);
-	env_set_builtin(env, "if", value_symbol_if_eval);
-	env_set_builtin(env, "while", value_symbol_while_eval);
-	env_set_builtin(env, "input", value_symbol_input_eval);
-	env_set_builtin(env, "join", value_symbol_join_eval);
-	env_set_builtin(env, "list", value_symbol_list_eval);
-	env_set_builtin(env, "load", value_symbol_load_eval);
-	env_set_builtin(env, "print", value_symbol_print_eval);
-	env_set_builtin(env, "tail", value_symbol_tail_eval);
+	size_t i;
+	for (i = 0; i < ENV_BUILTINS_TABLE_SIZE; ++i)
+		if (env_builtins[i].symbol)
+			env_set_builtin(env, env_builtins[i].symbol, env_builtins[i].builtin);
 }
 
 void
@@ -118,54 +389,120 @@ env_set_for_ancestor(Env *env, const Value *key, const Value *value)
 	env_set(env, key, value);
 }
 
-static EnvEntry*
-env_entry_alloc(const char *symbol, const Value *value)
+/* Checks that `key` is bound in a scope of `env` chain below the root env. */
+unsigned char
+env_shadows(const Env *env, const Value *key)
 {
-	EnvEntry *rv = malloc(sizeof(EnvEntry));
-	rv->next = NULL;
-	rv->symbol = strdup(symbol);
-	rv->value = value_copy(value);
-	return rv;
+	for (; env->parent; env = env->parent)
+		if (env_lookup(env, key))
+			return 1;
+	return 0;
 }
 
+/*
+Allocates entry of `slot` in `env` taking ownership of `value`. Entries of
+global env are allocated outside arena, because guards refer to them.
+*/
 static EnvEntry*
-env_entry_copy(const EnvEntry *entry)
+env_entry_alloc(const Env *env, size_t slot, Value *value)
 {
-	EnvEntry *rv = env_entry_alloc(entry->symbol, entry->value);
-	if (entry->next)
-		rv->next = env_entry_copy(entry->next);
+	EnvEntry *rv = env->slots
+		? pool_alloc_outside(sizeof(EnvEntry))
+		: pool_alloc(sizeof(EnvEntry));
+	rv->next = NULL;
+	rv->slot = slot;
+	rv->value = value;
+	rv->version = 0;
 	return rv;
 }
 
+/* Frees `entry` and entries chained after it. */
 static void
 env_entry_free(EnvEntry *entry)
 {
-	if (entry->next)
-		env_entry_free(entry->next);
-	free(entry);
+	EnvEntry *next;
+
+	for (; entry; entry = next) {
+		next = entry->next;
+		value_free(entry->value);
+		pool_free(entry, sizeof(EnvEntry));
+	}
 }
 
-static size_t
-env_entry_hash_key(const Value *key)
+/* Moves `entry` of frame and entries chained after it out of arena once. */
+static EnvEntry*
+env_entry_promote(EnvEntry *entry)
 {
-	char *ptr = key->symbol;
-	size_t hash = 0;
+	EnvEntry *rv = pool_forward(entry);
 
-	for (; *ptr != '\0'; ++ptr)
-		hash = *ptr + 31 * hash;
-	return hash % ENV_ENTRY_KEY_HASH_MODULO;
+	if (!rv) {
+		rv = pool_promote(entry, sizeof(EnvEntry));
+		pool_forward_set(entry, rv);
+		rv->value = value_promote(rv->value);
+		if (rv->next)
+			rv->next = env_entry_promote(rv->next);
+	}
+	return rv;
 }
 
 static EnvEntry*
 env_lookup(const Env *env, const Value *key)
 {
-	EnvEntry *entry = env->entries[env_entry_hash_key(key)];
-	for (; entry; entry = entry->next)
-		if (strcmp(entry->symbol, key->symbol) == 0)
+	size_t i;
+	EnvEntry *entry;
+
+	/* Global entry is a single load by symbol's slot */
+	if (env->slots)
+		return key->slot < env->slots_count ? env->slots[key->slot] : NULL;
+
+	/* Frames are small, so a scan beats hashing */
+	for (i = 0; i < env->count; ++i)
+		if (env->entries[i].slot == key->slot)
+			return (EnvEntry *)&env->entries[i];
+	for (entry = env->extra; entry; entry = entry->next)
+		if (entry->slot == key->slot)
 			return entry;
 	return NULL;
 }
 
+/*
+Doubles interned symbols table and rehashes symbols. Keeps the table at most
+half full.
+*/
+static void
+env_symbols_grow(void)
+{
+	size_t i,
+		j;
+
+	free(env_symbols_table);
+	env_symbols_table_size = env_symbols_table_size
+		? env_symbols_table_size * 2
+		: ENV_SLOTS_MIN_COUNT;
+	env_symbols_table = calloc(env_symbols_table_size, sizeof(size_t));
+	env_symbols = realloc(
+		env_symbols,
+		sizeof(char *) * env_symbols_table_size / 2
+	);
+
+	for (i = 0; i < env_symbols_count; ++i) {
+		j = env_symbols_hash(env_symbols[i]) & (env_symbols_table_size - 1);
+		while (env_symbols_table[j])
+			j = (j + 1) & (env_symbols_table_size - 1);
+		env_symbols_table[j] = i + 1;
+	}
+}
+
+static size_t
+env_symbols_hash(const char *symbol)
+{
+	size_t hash = 0;
+
+	for (; *symbol != '\0'; ++symbol)
+		hash = *symbol + 31 * hash;
+	return hash;
+}
+
 static void
 env_set_builtin(Env *env, const char *symbol, ValueBuiltin builtin)
 {
@@ -5,24 +5,62 @@
 #include "config.h"
 #include "value.h"
 
-typedef struct EnvEntry EnvEntry;
 struct EnvEntry {
 	EnvEntry *next;
-	char *symbol;
+	size_t slot;
 	Value *value;
+
+	/* Incremented on each redefinition */
+	unsigned long version;
 };
 
+/*
+Scope of bindings. Frame of lambda call is shared with closures created in it
+and freed when the last of them is freed, or when the call returns if only
+closures bound in the frame itself are left.
+
+Frame stores bindings of formals inline, so its size is fixed by formals
+count. Locals assigned later are chained in `extra`.
+*/
 typedef struct Env {
+	size_t refs;
+
+	/* Lexically enclosing scope */
 	Env *parent;
-	EnvEntry *entries[ENV_ENTRY_KEY_HASH_MODULO];
+
+	/*
+	Set for frame of `for` or `dotimes` counter. Other symbols are assigned
+	in the enclosing frame
+	*/
+	unsigned char loop;
+
+	/* Entries of global env indexed by slots of interned symbols */
+	EnvEntry **slots;
+	size_t slots_count;
+
+	EnvEntry *extra;
+	size_t size;
+	size_t count;
+	EnvEntry entries[];
 } Env;
 
-Env *env_alloc(void);
-Env *env_copy(const Env *);
+Env *env_alloc(size_t);
+Env *env_alloc_global(void);
+Env *env_alloc_loop(Env *);
+ValueBuiltin env_builtin_lookup(const char *);
+void env_clear(Env *);
+Env *env_copy(Env *);
 Value *env_get(const Env *, const Value *);
+ValueBuiltin env_get_builtin(const Env *, const Value *);
+EnvEntry *env_get_global_entry(const Env *, const Value *);
+size_t env_intern(const char *);
 void env_free(Env *);
+Env *env_promote(Env *);
+EnvEntry *env_put(Env *, const Value *, Value *);
+void env_release(Env *);
 void env_set(Env *, const Value *, const Value *);
 void env_set_builtins(Env *);
 void env_set_for_ancestor(Env *, const Value *, const Value *);
+unsigned char env_shadows(const Env *, const Value *);
 
 #endif /* _ENV_H */
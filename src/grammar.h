@@ -15,9 +15,9 @@
 			| <Qexpression>; \
 		Sexpression: '(' <Expression>* ')'; \
 		Qexpression: '{' <Expression>* '}'; \
-		Symbol: /[a-zA-Z0-9_+\\-*\\/\\\\=<>!&|]+/; \
+		Symbol: /[a-zA-Z0-9_+\\-*\\/\\\\=<>!&|?]+/; \
 		String: /\"(\\\\.|[^\"])*\"/ ; \
-		Number: /-?[0-9]+(\\.[0-9]+)?/; \
+		Number: /-?[0-9]+(\\.[0-9]+)?([eE][-+]?[0-9]+)?/; \
 		Comment: /;[^\\r\\n]*/; \
 	"
 
@@ -0,0 +1,478 @@
+#include <stdlib.h>
+#include <string.h>
+#include "hamt.h"
+#include "pool.h"
+
+static Hamt *hamt_edit(Hamt *hamt);
+static void hamt_entry_promote(HamtEntry *entry);
+static void hamt_entry_release(HamtEntry *entry);
+static HamtNode *hamt_node_alloc(size_t count);
+static void hamt_node_each(
+	const HamtNode *node,
+	HamtVisitor visitor,
+	void *data
+);
+static HamtNode *hamt_node_edit(HamtNode *node);
+static const HamtEntry *hamt_node_get(
+	const HamtNode *node,
+	unsigned shift,
+	const Value *key,
+	size_t hash
+);
+static HamtNode *hamt_node_insert(HamtNode *node, size_t i, HamtSlot slot);
+static void hamt_node_promote(HamtNode *node);
+static HamtNode *hamt_node_put(
+	HamtNode *node,
+	unsigned shift,
+	HamtEntry *entry,
+	unsigned char *added
+);
+static void hamt_node_release(HamtNode *node);
+static HamtNode *hamt_node_remove(
+	HamtNode *node,
+	unsigned shift,
+	const Value *key,
+	size_t hash
+);
+static void hamt_node_remove_slot(HamtNode *node, size_t i);
+static size_t hamt_slot_index(const HamtNode *node, unsigned long bit);
+
+/* Allocates empty map. */
+Hamt*
+hamt_alloc(void)
+{
+	Hamt *rv = malloc(sizeof(Hamt));
+	rv->refs = 1;
+	rv->count = 0;
+	rv->root = hamt_node_alloc(0);
+	return rv;
+}
+
+/* Shares map with new owner. */
+Hamt*
+hamt_copy(Hamt *hamt)
+{
+	++hamt->refs;
+	return hamt;
+}
+
+/* Calls `visitor` with each key, value and `data` in order of hashes. */
+void
+hamt_each(const Hamt *hamt, HamtVisitor visitor, void *data)
+{
+	hamt_node_each(hamt->root, visitor, data);
+}
+
+void
+hamt_free(Hamt *hamt)
+{
+	if (--hamt->refs > 0)
+		return;
+
+	hamt_node_release(hamt->root);
+	free(hamt);
+}
+
+/* Returns value of `key` with precomputed `hash` or NULL. */
+const Value*
+hamt_get(const Hamt *hamt, const Value *key, size_t hash)
+{
+	const HamtEntry *entry = hamt_node_get(hamt->root, 0, key, hash);
+	return entry ? entry->value : NULL;
+}
+
+/* Moves keys and values out of arena once. */
+void
+hamt_promote(Hamt *hamt)
+{
+	if (pool_forward(hamt))
+		return;
+	pool_forward_set(hamt, hamt);
+
+	hamt_node_promote(hamt->root);
+}
+
+/*
+Returns version of `hamt` with `key` of precomputed `hash` bound to `value`.
+Takes ownership of reference to `hamt`, of `key` and of `value`.
+*/
+Hamt*
+hamt_put(Hamt *hamt, Value *key, size_t hash, Value *value)
+{
+	unsigned char added = 0;
+	HamtEntry *entry = malloc(sizeof(HamtEntry));
+
+	entry->refs = 1;
+	entry->hash = hash;
+	entry->key = key;
+	entry->value = value;
+
+	hamt = hamt_edit(hamt);
+	hamt->root = hamt_node_put(hamt->root, 0, entry, &added);
+	hamt->count += added;
+	return hamt;
+}
+
+/*
+Returns version of `hamt` without `key` of precomputed `hash`. Takes ownership
+of reference to `hamt`. Map without the key is returned as is.
+*/
+Hamt*
+hamt_remove(Hamt *hamt, const Value *key, size_t hash)
+{
+	if (!hamt_node_get(hamt->root, 0, key, hash))
+		return hamt;
+
+	hamt = hamt_edit(hamt);
+	hamt->root = hamt_node_remove(hamt->root, 0, key, hash);
+	if (!hamt->root)
+		hamt->root = hamt_node_alloc(0);
+	--hamt->count;
+	return hamt;
+}
+
+/*
+Returns `hamt` if caller holds the only reference to it or a new version
+sharing its nodes. Takes ownership of the reference.
+*/
+static Hamt*
+hamt_edit(Hamt *hamt)
+{
+	Hamt *rv;
+
+	if (hamt->refs == 1)
+		return hamt;
+
+	rv = malloc(sizeof(Hamt));
+	rv->refs = 1;
+	rv->count = hamt->count;
+	rv->root = hamt->root;
+	++rv->root->refs;
+	--hamt->refs;
+	return rv;
+}
+
+/* Moves key and value of shared `entry` out of arena once. */
+static void
+hamt_entry_promote(HamtEntry *entry)
+{
+	if (pool_forward(entry))
+		return;
+	pool_forward_set(entry, entry);
+
+	entry->key = value_promote(entry->key);
+	entry->value = value_promote(entry->value);
+}
+
+static void
+hamt_entry_release(HamtEntry *entry)
+{
+	if (--entry->refs > 0)
+		return;
+
+	value_free(entry->key);
+	value_free(entry->value);
+	free(entry);
+}
+
+/* Allocates node with room for `count` slots. */
+static HamtNode*
+hamt_node_alloc(size_t count)
+{
+	HamtNode *rv = malloc(sizeof(HamtNode) + sizeof(HamtSlot) * count);
+	rv->refs = 1;
+	rv->promoted = 0;
+	rv->bitmap = 0;
+	rv->count = count;
+	return rv;
+}
+
+static void
+hamt_node_each(const HamtNode *node, HamtVisitor visitor, void *data)
+{
+	size_t i;
+
+	for (i = 0; i < node->count; ++i) {
+		if (node->slots[i].entry)
+			visitor(
+				node->slots[i].entry->key,
+				node->slots[i].entry->value,
+				data
+			);
+		else
+			hamt_node_each(node->slots[i].node, visitor, data);
+	}
+}
+
+/*
+Returns `node` if it is referenced only by the caller, who already owns the
+path to it, or its copy otherwise. Takes ownership of the reference.
+*/
+static HamtNode*
+hamt_node_edit(HamtNode *node)
+{
+	size_t i;
+	HamtNode *rv;
+
+	/* Node changed in place may get entries from arena */
+	if (node->refs == 1) {
+		node->promoted = 0;
+		return node;
+	}
+
+	rv = hamt_node_alloc(node->count);
+	rv->bitmap = node->bitmap;
+	for (i = 0; i < node->count; ++i) {
+		rv->slots[i] = node->slots[i];
+		if (rv->slots[i].entry)
+			++rv->slots[i].entry->refs;
+		else
+			++rv->slots[i].node->refs;
+	}
+	--node->refs;
+	return rv;
+}
+
+static const HamtEntry*
+hamt_node_get(
+	const HamtNode *node,
+	unsigned shift,
+	const Value *key,
+	size_t hash
+)
+{
+	size_t i;
+	unsigned long bit;
+
+	for (; shift < HAMT_HASH_BITS; shift += HAMT_BITS) {
+		bit = 1UL << ((hash >> shift) & HAMT_MASK);
+		if (!(node->bitmap & bit))
+			return NULL;
+
+		i = hamt_slot_index(node, bit);
+		if (!node->slots[i].entry) {
+			node = node->slots[i].node;
+			continue;
+		}
+		if (
+			node->slots[i].entry->hash == hash
+			&& value_eq(node->slots[i].entry->key, key)
+		)
+			return node->slots[i].entry;
+		return NULL;
+	}
+
+	/* List of entries with equal hashes */
+	for (i = 0; i < node->count; ++i)
+		if (value_eq(node->slots[i].entry->key, key))
+			return node->slots[i].entry;
+	return NULL;
+}
+
+/* Inserts `slot` at `i` to `node` referenced only by caller. */
+static HamtNode*
+hamt_node_insert(HamtNode *node, size_t i, HamtSlot slot)
+{
+	node = realloc(
+		node,
+		sizeof(HamtNode) + sizeof(HamtSlot) * (node->count + 1)
+	);
+	memmove(
+		&node->slots[i + 1],
+		&node->slots[i],
+		sizeof(HamtSlot) * (node->count - i)
+	);
+	node->slots[i] = slot;
+	++node->count;
+	return node;
+}
+
+/*
+Moves entries under shared `node` out of arena once. Nodes promoted by
+previous forms are skipped, so a new version promotes only its new path.
+*/
+static void
+hamt_node_promote(HamtNode *node)
+{
+	size_t i;
+
+	if (node->promoted)
+		return;
+	node->promoted = 1;
+
+	for (i = 0; i < node->count; ++i) {
+		if (node->slots[i].entry)
+			hamt_entry_promote(node->slots[i].entry);
+		else
+			hamt_node_promote(node->slots[i].node);
+	}
+}
+
+/*
+Binds key of `entry` under `node` of level `shift`, replacing entry of an
+equal key. Sets `added` if the key is new. Takes ownership of references.
+*/
+static HamtNode*
+hamt_node_put(
+	HamtNode *node,
+	unsigned shift,
+	HamtEntry *entry,
+	unsigned char *added
+)
+{
+	size_t i;
+	unsigned long bit;
+	HamtSlot slot = {entry, NULL};
+	HamtEntry *old;
+	HamtNode *child;
+
+	node = hamt_node_edit(node);
+
+	if (shift >= HAMT_HASH_BITS) {
+		/* List of entries with equal hashes */
+		for (i = 0; i < node->count; ++i) {
+			if (value_eq(node->slots[i].entry->key, entry->key)) {
+				hamt_entry_release(node->slots[i].entry);
+				node->slots[i].entry = entry;
+				return node;
+			}
+		}
+		*added = 1;
+		return hamt_node_insert(node, node->count, slot);
+	}
+
+	bit = 1UL << ((entry->hash >> shift) & HAMT_MASK);
+	i = hamt_slot_index(node, bit);
+	if (!(node->bitmap & bit)) {
+		*added = 1;
+		node->bitmap |= bit;
+		return hamt_node_insert(node, i, slot);
+	}
+
+	old = node->slots[i].entry;
+	if (!old) {
+		node->slots[i].node = hamt_node_put(
+			node->slots[i].node,
+			shift + HAMT_BITS,
+			entry,
+			added
+		);
+	} else if (old->hash == entry->hash && value_eq(old->key, entry->key)) {
+		hamt_entry_release(old);
+		node->slots[i].entry = entry;
+	} else {
+		/* Push both entries to a new level */
+		child = hamt_node_put(
+			hamt_node_alloc(0),
+			shift + HAMT_BITS,
+			old,
+			added
+		);
+		node->slots[i].entry = NULL;
+		node->slots[i].node = hamt_node_put(
+			child,
+			shift + HAMT_BITS,
+			entry,
+			added
+		);
+	}
+	return node;
+}
+
+static void
+hamt_node_release(HamtNode *node)
+{
+	size_t i;
+
+	if (--node->refs > 0)
+		return;
+
+	for (i = 0; i < node->count; ++i) {
+		if (node->slots[i].entry)
+			hamt_entry_release(node->slots[i].entry);
+		else
+			hamt_node_release(node->slots[i].node);
+	}
+	free(node);
+}
+
+/*
+Removes present `key` of `hash` under `node` of level `shift`. Returns NULL
+instead of empty node. Subnode left with a single entry is replaced by it.
+*/
+static HamtNode*
+hamt_node_remove(
+	HamtNode *node,
+	unsigned shift,
+	const Value *key,
+	size_t hash
+)
+{
+	size_t i = 0;
+	unsigned long bit = 0;
+	HamtNode *child;
+
+	node = hamt_node_edit(node);
+
+	if (shift >= HAMT_HASH_BITS) {
+		/* List of entries with equal hashes */
+		while (!value_eq(node->slots[i].entry->key, key))
+			++i;
+		hamt_entry_release(node->slots[i].entry);
+	} else {
+		bit = 1UL << ((hash >> shift) & HAMT_MASK);
+		i = hamt_slot_index(node, bit);
+		if (node->slots[i].entry) {
+			hamt_entry_release(node->slots[i].entry);
+		} else {
+			child = hamt_node_remove(
+				node->slots[i].node,
+				shift + HAMT_BITS,
+				key,
+				hash
+			);
+			if (child && child->count == 1 && child->slots[0].entry) {
+				node->slots[i].entry = child->slots[0].entry;
+				node->slots[i].node = NULL;
+				++node->slots[i].entry->refs;
+				hamt_node_release(child);
+				return node;
+			} else if (child) {
+				node->slots[i].node = child;
+				return node;
+			}
+		}
+		node->bitmap &= ~bit;
+	}
+
+	hamt_node_remove_slot(node, i);
+	if (node->count == 0) {
+		free(node);
+		return NULL;
+	}
+	return node;
+}
+
+/* Removes slot `i` of `node` referenced only by caller. */
+static void
+hamt_node_remove_slot(HamtNode *node, size_t i)
+{
+	--node->count;
+	memmove(
+		&node->slots[i],
+		&node->slots[i + 1],
+		sizeof(HamtSlot) * (node->count - i)
+	);
+}
+
+/* Returns index of slot for position `bit` among occupied slots. */
+static size_t
+hamt_slot_index(const HamtNode *node, unsigned long bit)
+{
+	size_t count = 0;
+	unsigned long bits = node->bitmap & (bit - 1);
+
+	for (; bits; bits &= bits - 1)
+		++count;
+	return count;
+}
@@ -0,0 +1,64 @@
+#ifndef _HAMT_H
+#define _HAMT_H
+
+#include <stdlib.h>
+#include "config.h"
+#include "value.h"
+
+#define HAMT_MASK ((1 << HAMT_BITS) - 1)
+
+/* Bits of hash. Keys with equal hashes below this level share a list node */
+#define HAMT_HASH_BITS (sizeof(size_t) * 8)
+
+/* Key and value. Immutable and shared between nodes of versions of maps */
+typedef struct HamtEntry {
+	size_t refs;
+	size_t hash;
+	Value *key;
+	Value *value;
+} HamtEntry;
+
+typedef struct HamtNode HamtNode;
+
+/* Slot of node holds either an entry or a subnode */
+typedef struct HamtSlot {
+	HamtEntry *entry;
+	HamtNode *node;
+} HamtSlot;
+
+/*
+Node of hash array mapped trie. Bit of `bitmap` is set for each occupied
+position of hash bits of the node's level, and occupied positions are
+compacted in `slots`. Nodes below the last level are lists of entries with
+equal hashes and don't use `bitmap`
+*/
+struct HamtNode {
+	size_t refs;
+
+	/* Set once entries under the node are moved out of arena */
+	unsigned char promoted;
+
+	unsigned long bitmap;
+	size_t count;
+	HamtSlot slots[];
+};
+
+/* Immutable map. Shared between copies of map value */
+typedef struct Hamt {
+	size_t refs;
+	size_t count;
+	HamtNode *root;
+} Hamt;
+
+typedef void (*HamtVisitor)(const Value *, const Value *, void *);
+
+Hamt *hamt_alloc(void);
+Hamt *hamt_copy(Hamt *);
+void hamt_each(const Hamt *, HamtVisitor, void *);
+void hamt_free(Hamt *);
+const Value *hamt_get(const Hamt *, const Value *, size_t);
+void hamt_promote(Hamt *);
+Hamt *hamt_put(Hamt *, Value *, size_t, Value *);
+Hamt *hamt_remove(Hamt *, const Value *, size_t);
+
+#endif /* _HAMT_H */
@@ -0,0 +1,142 @@
+#include <string.h>
+#include "config.h"
+#include "hashcons.h"
+
+/*
+Weak table of hash-consed values. Consed value is immutable and shared by all
+its copies, the table doesn't own it and forgets it when the last copy is
+freed.
+
+Children of consed expression are consed too, except numbers and symbols, so
+equal values are found by comparing pointers of their children.
+*/
+
+static unsigned char hashcons_eq(const Value *x, const Value *y);
+static void hashcons_grow(void);
+
+unsigned char hashcons_enabled = 0;
+
+/* Open addressing table of consed values by their cached hashes */
+static Value **hashcons_values = NULL;
+static size_t hashcons_count = 0;
+static size_t hashcons_size = 0;
+
+/* Returns consed value equal to `value` with cached hash or NULL. */
+Value*
+hashcons_find(const Value *value)
+{
+	size_t i;
+
+	if (hashcons_count == 0)
+		return NULL;
+	for (
+		i = value->hash & (hashcons_size - 1);
+		hashcons_values[i];
+		i = (i + 1) & (hashcons_size - 1)
+	)
+		if (
+			hashcons_values[i]->hash == value->hash
+			&& hashcons_eq(hashcons_values[i], value)
+		)
+			return hashcons_values[i];
+	return NULL;
+}
+
+/* Adds consed `value` with cached hash. */
+void
+hashcons_insert(Value *value)
+{
+	size_t i;
+
+	/* Keep load factor under a half */
+	if (2 * (hashcons_count + 1) > hashcons_size)
+		hashcons_grow();
+
+	i = value->hash & (hashcons_size - 1);
+	while (hashcons_values[i])
+		i = (i + 1) & (hashcons_size - 1);
+	hashcons_values[i] = value;
+	++hashcons_count;
+}
+
+/*
+Removes consed `value`. Values after it are shifted back to the hole, unless
+their probing starts after the hole, so lookups never stop early.
+*/
+void
+hashcons_remove(const Value *value)
+{
+	size_t i = value->hash & (hashcons_size - 1),
+		j,
+		mask = hashcons_size - 1;
+
+	while (hashcons_values[i] != value)
+		i = (i + 1) & mask;
+
+	for (j = (i + 1) & mask; hashcons_values[j]; j = (j + 1) & mask) {
+		if (
+			((j - (hashcons_values[j]->hash & mask)) & mask)
+			>= ((j - i) & mask)
+		) {
+			hashcons_values[i] = hashcons_values[j];
+			i = j;
+		}
+	}
+	hashcons_values[i] = NULL;
+	--hashcons_count;
+}
+
+/* Compares `x` and `y` whose children are consed or numbers and symbols. */
+static unsigned char
+hashcons_eq(const Value *x, const Value *y)
+{
+	size_t i;
+	const Value *a,
+		*b;
+
+	if (x->type != y->type)
+		return 0;
+	else if (x->type == STRING_TYPE)
+		return strcmp(x->string, y->string) == 0;
+	else if (x->children_count != y->children_count)
+		return 0;
+
+	for (i = 0; i < x->children_count; ++i) {
+		a = x->children[i];
+		b = y->children[i];
+		if (a == b)
+			continue;
+		else if (a->refs || b->refs || a->type != b->type)
+			return 0;
+
+		/* Zeros of different signs are printed differently */
+		if (a->type == NUMBER_TYPE) {
+			if (memcmp(&a->number, &b->number, sizeof(ValueNumber)) != 0)
+				return 0;
+		} else if (strcmp(a->symbol, b->symbol) != 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void
+hashcons_grow(void)
+{
+	size_t i,
+		j,
+		size = hashcons_size;
+	Value **values = hashcons_values;
+
+	hashcons_size = size ? size * 2 : HASHCONS_MIN_SIZE;
+	hashcons_values = calloc(hashcons_size, sizeof(Value *));
+	for (i = 0; i < size; ++i) {
+		if (!values[i])
+			continue;
+		j = values[i]->hash & (hashcons_size - 1);
+		while (hashcons_values[j])
+			j = (j + 1) & (hashcons_size - 1);
+		hashcons_values[j] = values[i];
+	}
+	free(values);
+}
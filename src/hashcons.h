@@ -0,0 +1,13 @@
+#ifndef _HASHCONS_H
+#define _HASHCONS_H
+
+#include "value.h"
+
+/* Command line flag */
+extern unsigned char hashcons_enabled;
+
+Value *hashcons_find(const Value *);
+void hashcons_insert(Value *);
+void hashcons_remove(const Value *);
+
+#endif /* _HASHCONS_H */
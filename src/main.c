@@ -2,7 +2,11 @@
 #include <editline.h>
 #include "env.h"
 #include "grammar.h"
+#include "hashcons.h"
 #include "mpc.h"
+#include "optimize.h"
+#include "output.h"
+#include "pool.h"
 #include "value.h"
 
 static void parsers_init(void);
@@ -15,20 +19,29 @@ interpret(Env *env)
 {
 	char *input;
 	mpc_result_t mpc_result;
-	Value *value;
+	Value *result,
+		*value;
 
 	while (1) {
+		/* Show printed results before the prompt */
+		output_flush();
 		input = readline(">>> ");
 		add_history(input);
 
 		/* Parse an input */
 		if (mpc_parse("<stdin>", input, Program, &mpc_result)) {
-			/* Read, eval and print parsed tree */
-			value = value_eval(value_read(mpc_result.output), env);
-			value_println(value);
+			/* Read, optimize, eval and print parsed tree in arena */
+			value_arena_begin();
+			value = value_read(mpc_result.output);
+			if (optimize_enabled)
+				value = optimize(value, env);
+			result = value_eval(value, env);
+			value_println(result);
 
-			/* Free eval result and parsed tree */
+			/* Free eval result, code and parsed tree */
+			value_free(result);
 			value_free(value);
+			value_arena_end();
 			mpc_ast_delete(mpc_result.output);
 		} else {
 			/* Print parsing error */
@@ -86,13 +99,13 @@ static void
 read(size_t argc, char **argv, Env *env)
 {
 	size_t i;
-	Value *value;
+	Value *filename,
+		*value;
 
 	/* Read filenames */
 	for (i = 1; i < argc; i++) {
-		value = value_expression_alloc(SEXPRESSION_TYPE);
-		value_add_child(value, value_string_alloc(argv[i]));
-		value = value_symbol_load_eval(value, env);
+		filename = value_string_alloc(argv[i]);
+		value = value_symbol_load_eval(&filename, 1, env);
 		if (value->type == ERROR_TYPE)
 			value_println(value);
 		value_free(value);
@@ -101,21 +114,50 @@ read(size_t argc, char **argv, Env *env)
 
 int
 main(int argc, char **argv) {
-	Env *env = env_alloc();
+	int i,
+		files_count = 0;
+	unsigned char std = 1;
+	char *std_argv[] = {argv[0], "std"};
+	Env *env = env_alloc_global();
 	env_set_builtins(env);
 
+	/* Parse flags and move filenames to the beginning of arguments */
+	for (i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--no-std") == 0)
+			std = 0;
+		else if (strcmp(argv[i], "--optimize") == 0)
+			optimize_enabled = 1;
+		else if (strcmp(argv[i], "--dump-optimized") == 0)
+			optimize_enabled = optimize_dump = 1;
+		else if (strcmp(argv[i], "--pool-stats") == 0)
+			pool_stats_enabled = 1;
+		else if (strcmp(argv[i], "--hash-cons") == 0)
+			hashcons_enabled = 1;
+		else
+			argv[++files_count] = argv[i];
+	}
+
 	parsers_init();
-	if (argc == 1) {
-		argv[argc++] = "std";
-		read(argc, argv, env);
-		interpret(env);
-	} else if (argc == 2 && strstr(argv[1], "--no-std")) {
+	if (files_count == 0) {
+		if (std)
+			read(2, std_argv, env);
 		interpret(env);
 	} else {
-		read(argc, argv, env);
+		read(files_count + 1, argv, env);
 	}
 	parsers_free();
 
 	env_free(env);
+	output_flush();
+
+	/* Objects still live after env is freed are leaked */
+	if (pool_stats_enabled)
+		fprintf(
+			stderr,
+			"pool: %zu live, %zu peak, %zu slabs\n",
+			pool_stats.live,
+			pool_stats.peak,
+			pool_stats.slabs
+		);
 	return EXIT_SUCCESS;
 }
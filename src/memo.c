@@ -0,0 +1,219 @@
+#include <stdlib.h>
+#include "config.h"
+#include "memo.h"
+#include "pool.h"
+
+static void memo_entry_free(MemoEntry *entry);
+static void memo_evict(Memo *memo);
+static void memo_grow(Memo *memo);
+static void memo_list_push(Memo *memo, MemoEntry *entry);
+static void memo_list_remove(Memo *memo, MemoEntry *entry);
+
+/* Allocates cache of `function` with at most `capacity` entries. */
+Memo*
+memo_alloc(Value *function, size_t capacity)
+{
+	Memo *rv = malloc(sizeof(Memo));
+	rv->refs = 1;
+	rv->function = function;
+	rv->capacity = capacity;
+	rv->count = 0;
+	rv->hits = 0;
+	rv->misses = 0;
+	rv->newest = NULL;
+	rv->oldest = NULL;
+	rv->escaped = 0;
+	rv->recent = 0;
+
+	/* Buckets grow with entries, so a large capacity costs nothing upfront */
+	rv->buckets_count = MEMO_MIN_BUCKETS_COUNT;
+	rv->buckets = calloc(rv->buckets_count, sizeof(MemoEntry *));
+	return rv;
+}
+
+/* Shares cache with new owner. */
+Memo*
+memo_copy(Memo *memo)
+{
+	++memo->refs;
+	return memo;
+}
+
+void
+memo_free(Memo *memo)
+{
+	MemoEntry *entry,
+		*older;
+
+	if (--memo->refs > 0)
+		return;
+
+	for (entry = memo->newest; entry; entry = older) {
+		older = entry->older;
+		memo_entry_free(entry);
+	}
+	value_free(memo->function);
+	free(memo->buckets);
+	free(memo);
+}
+
+/*
+Returns copy of cached result for `args` with precomputed `hash` or NULL.
+
+Found entry becomes the most recently used.
+*/
+Value*
+memo_get(Memo *memo, const Value *args, size_t hash)
+{
+	MemoEntry *entry = memo->buckets[hash % memo->buckets_count];
+
+	for (; entry; entry = entry->next) {
+		if (entry->hash == hash && value_eq(entry->args, args)) {
+			++memo->hits;
+			memo_list_remove(memo, entry);
+			memo_list_push(memo, entry);
+			return value_copy(entry->result);
+		}
+	}
+
+	++memo->misses;
+	return NULL;
+}
+
+/* Moves wrapped function and cached values out of arena once. */
+void
+memo_promote(Memo *memo)
+{
+	MemoEntry *entry;
+
+	if (pool_forward(memo))
+		return;
+	pool_forward_set(memo, memo);
+
+	memo->function = value_promote(memo->function);
+	for (entry = memo->newest; entry; entry = entry->older) {
+		entry->args = value_promote(entry->args);
+		entry->result = value_promote(entry->result);
+	}
+}
+
+/* Moves cached values of `recent` entries out of arena and resets it. */
+void
+memo_promote_recent(Memo *memo)
+{
+	MemoEntry *entry = memo->newest;
+
+	for (; entry && memo->recent > 0; entry = entry->older, --memo->recent) {
+		entry->args = value_promote(entry->args);
+		entry->result = value_promote(entry->result);
+	}
+	memo->recent = 0;
+}
+
+/*
+Caches copy of `result` for `args` with precomputed `hash`. Takes ownership
+of `args`.
+
+Evicts the least recently used entry if cache is full.
+*/
+void
+memo_put(Memo *memo, Value *args, size_t hash, const Value *result)
+{
+	MemoEntry *entry,
+		**bucket;
+
+	if (memo->capacity == 0) {
+		value_free(args);
+		return;
+	}
+	if (memo->count == memo->capacity)
+		memo_evict(memo);
+
+	entry = malloc(sizeof(MemoEntry));
+	entry->hash = hash;
+	entry->args = args;
+	entry->result = value_copy(result);
+
+	/* Insert to bucket and LRU list */
+	bucket = &memo->buckets[hash % memo->buckets_count];
+	entry->next = *bucket;
+	*bucket = entry;
+	memo_list_push(memo, entry);
+	++memo->count;
+
+	/* Keep load factor under one */
+	if (memo->count > memo->buckets_count)
+		memo_grow(memo);
+}
+
+static void
+memo_entry_free(MemoEntry *entry)
+{
+	value_free(entry->args);
+	value_free(entry->result);
+	free(entry);
+}
+
+/* Removes the least recently used entry. */
+static void
+memo_evict(Memo *memo)
+{
+	MemoEntry *entry = memo->oldest,
+		**ptr = &memo->buckets[entry->hash % memo->buckets_count];
+
+	/* Unlink from bucket */
+	while (*ptr != entry)
+		ptr = &(*ptr)->next;
+	*ptr = entry->next;
+
+	memo_list_remove(memo, entry);
+	memo_entry_free(entry);
+	--memo->count;
+}
+
+/* Doubles buckets of `memo` and rehashes entries. */
+static void
+memo_grow(Memo *memo)
+{
+	size_t count = memo->buckets_count * 2;
+	MemoEntry *entry,
+		**buckets = calloc(count, sizeof(MemoEntry *)),
+		**bucket;
+
+	for (entry = memo->newest; entry; entry = entry->older) {
+		bucket = &buckets[entry->hash % count];
+		entry->next = *bucket;
+		*bucket = entry;
+	}
+	free(memo->buckets);
+	memo->buckets = buckets;
+	memo->buckets_count = count;
+}
+
+/* Pushes `entry` to the head of LRU list. */
+static void
+memo_list_push(Memo *memo, MemoEntry *entry)
+{
+	++memo->recent;
+	entry->newer = NULL;
+	entry->older = memo->newest;
+	if (memo->newest)
+		memo->newest->newer = entry;
+	else
+		memo->oldest = entry;
+	memo->newest = entry;
+}
+
+static void
+memo_list_remove(Memo *memo, MemoEntry *entry)
+{
+	if (entry->newer)
+		entry->newer->older = entry->older;
+	else
+		memo->newest = entry->older;
+
+	if (entry->older)
+		entry->older->newer = entry->newer;
+	else
+		memo->oldest = entry->newer;
+}
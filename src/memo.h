@@ -0,0 +1,56 @@
+#ifndef _MEMO_H
+#define _MEMO_H
+
+#include <stdlib.h>
+#include "value.h"
+
+typedef struct MemoEntry MemoEntry;
+struct MemoEntry {
+	/* Next entry in the same bucket */
+	MemoEntry *next;
+
+	/* Neighbours in the LRU list */
+	MemoEntry *newer;
+	MemoEntry *older;
+
+	size_t hash;
+	Value *args;
+	Value *result;
+};
+
+/* Cache of a memoized function. Shared between copies of function value. */
+typedef struct Memo {
+	size_t refs;
+	Value *function;
+
+	/* Statistics */
+	size_t capacity;
+	size_t count;
+	size_t hits;
+	size_t misses;
+
+	/* Hash table of entries */
+	size_t buckets_count;
+	MemoEntry **buckets;
+
+	/* LRU list of entries. Head is the most recently used entry */
+	MemoEntry *newest;
+	MemoEntry *oldest;
+
+	/*
+	Set while cache is recorded as filled by a top level form. Entries put
+	since then are among `recent` most recently used ones
+	*/
+	unsigned char escaped;
+	size_t recent;
+} Memo;
+
+Memo *memo_alloc(Value *, size_t);
+Memo *memo_copy(Memo *);
+void memo_free(Memo *);
+Value *memo_get(Memo *, const Value *, size_t);
+void memo_promote(Memo *);
+void memo_promote_recent(Memo *);
+void memo_put(Memo *, Value *, size_t, const Value *);
+
+#endif /* _MEMO_H */
@@ -0,0 +1,724 @@
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "number.h"
+
+/*
+Shortest decimal representation of doubles by Grisu2 algorithm of Florian
+Loitsch. Digits are generated from a 64-bit fixed point approximation of the
+number scaled by a cached power of ten, so no big integer arithmetic is
+needed. Output always reads back to the same double and is the shortest in
+nearly all cases.
+
+Literals are parsed in one pass to 19 significant digits and a decimal
+exponent. Exact cases are computed in doubles by Clinger's fast path, others
+by Eisel-Lemire algorithm with 128-bit powers of five. Rare ambiguous cases
+and exponents out of the table fall back to `strtod`.
+*/
+
+/* Extended floating point number `f * 2^e` */
+typedef struct NumberFp {
+	uint64_t f;
+	int e;
+} NumberFp;
+
+static void number_boundaries(double x, NumberFp *minus, NumberFp *plus);
+static NumberFp number_cached_power(int e, int *k);
+static size_t number_digits(
+	NumberFp w,
+	NumberFp mp,
+	uint64_t delta,
+	char *digits,
+	int *k
+);
+static NumberFp number_fp(double x);
+static size_t number_grisu(double x, char *digits, int *k);
+static unsigned char number_lemire(uint64_t w, int q, double *x);
+static NumberFp number_multiply(NumberFp x, NumberFp y);
+static NumberFp number_normalize(NumberFp x);
+static uint64_t number_product(uint64_t x, uint64_t y, uint64_t *high);
+static void number_round(
+	char *digits,
+	size_t length,
+	uint64_t delta,
+	uint64_t rest,
+	uint64_t ten_kappa,
+	uint64_t wp_w
+);
+static size_t number_uint_format(uint64_t n, char *buffer);
+
+#define NUMBER_HIDDEN_BIT (0x10000000000000ULL)
+#define NUMBER_SIGNIFICAND_MASK (0xfffffffffffffULL)
+#define NUMBER_SIGNIFICAND_SIZE (52)
+#define NUMBER_EXPONENT_BIAS (1075)
+#define NUMBER_FAST_EXPONENT_MAX (22)
+#define NUMBER_POWERS_5_MIN (-64)
+#define NUMBER_POWERS_5_MAX (64)
+#define NUMBER_SIGNIFICANT_DIGITS (19)
+#define NUMBER_LITERAL_EXPONENT_MAX (100000)
+#define NUMBER_POINT_MIN (-5)
+#define NUMBER_POINT_MAX (21)
+
+/* Normalized powers of ten from 10^-348 to 10^340 with step 8 */
+static const uint64_t number_powers_f[] = {
+	0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+	0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+	0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+	0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+	0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+	0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+	0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+	0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+	0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+	0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+	0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+	0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+	0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+	0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+	0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+	0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+	0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+	0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+	0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+	0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+	0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+	0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+	0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+	0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+	0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+	0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+	0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+	0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+	0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+};
+static const short number_powers_e[] = {
+	-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+	-954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+	-688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+	-422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+	-157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+	109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+	375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+	641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+	907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+/* Powers of ten scaling the distance to the number for rounding */
+static const uint64_t number_powers_10[] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+	10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+	100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+	100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+	100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL,
+};
+
+/* Exact powers of ten for the fast path */
+static const double number_exact_powers_10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+	1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+/*
+Powers of five from 5^-64 to 5^64 as 128-bit numbers with the highest bit set.
+Negative powers are rounded up
+*/
+static const uint64_t number_powers_5[][2] = {
+	{0xa87fea27a539e9a5ULL, 0x3f2398d747b36224ULL},
+	{0xd29fe4b18e88640eULL, 0x8eec7f0d19a03aadULL},
+	{0x83a3eeeef9153e89ULL, 0x1953cf68300424acULL},
+	{0xa48ceaaab75a8e2bULL, 0x5fa8c3423c052dd7ULL},
+	{0xcdb02555653131b6ULL, 0x3792f412cb06794dULL},
+	{0x808e17555f3ebf11ULL, 0xe2bbd88bbee40bd0ULL},
+	{0xa0b19d2ab70e6ed6ULL, 0x5b6aceaeae9d0ec4ULL},
+	{0xc8de047564d20a8bULL, 0xf245825a5a445275ULL},
+	{0xfb158592be068d2eULL, 0xeed6e2f0f0d56712ULL},
+	{0x9ced737bb6c4183dULL, 0x55464dd69685606bULL},
+	{0xc428d05aa4751e4cULL, 0xaa97e14c3c26b886ULL},
+	{0xf53304714d9265dfULL, 0xd53dd99f4b3066a8ULL},
+	{0x993fe2c6d07b7fabULL, 0xe546a8038efe4029ULL},
+	{0xbf8fdb78849a5f96ULL, 0xde98520472bdd033ULL},
+	{0xef73d256a5c0f77cULL, 0x963e66858f6d4440ULL},
+	{0x95a8637627989aadULL, 0xdde7001379a44aa8ULL},
+	{0xbb127c53b17ec159ULL, 0x5560c018580d5d52ULL},
+	{0xe9d71b689dde71afULL, 0xaab8f01e6e10b4a6ULL},
+	{0x9226712162ab070dULL, 0xcab3961304ca70e8ULL},
+	{0xb6b00d69bb55c8d1ULL, 0x3d607b97c5fd0d22ULL},
+	{0xe45c10c42a2b3b05ULL, 0x8cb89a7db77c506aULL},
+	{0x8eb98a7a9a5b04e3ULL, 0x77f3608e92adb242ULL},
+	{0xb267ed1940f1c61cULL, 0x55f038b237591ed3ULL},
+	{0xdf01e85f912e37a3ULL, 0x6b6c46dec52f6688ULL},
+	{0x8b61313bbabce2c6ULL, 0x2323ac4b3b3da015ULL},
+	{0xae397d8aa96c1b77ULL, 0xabec975e0a0d081aULL},
+	{0xd9c7dced53c72255ULL, 0x96e7bd358c904a21ULL},
+	{0x881cea14545c7575ULL, 0x7e50d64177da2e54ULL},
+	{0xaa242499697392d2ULL, 0xdde50bd1d5d0b9e9ULL},
+	{0xd4ad2dbfc3d07787ULL, 0x955e4ec64b44e864ULL},
+	{0x84ec3c97da624ab4ULL, 0xbd5af13bef0b113eULL},
+	{0xa6274bbdd0fadd61ULL, 0xecb1ad8aeacdd58eULL},
+	{0xcfb11ead453994baULL, 0x67de18eda5814af2ULL},
+	{0x81ceb32c4b43fcf4ULL, 0x80eacf948770ced7ULL},
+	{0xa2425ff75e14fc31ULL, 0xa1258379a94d028dULL},
+	{0xcad2f7f5359a3b3eULL, 0x096ee45813a04330ULL},
+	{0xfd87b5f28300ca0dULL, 0x8bca9d6e188853fcULL},
+	{0x9e74d1b791e07e48ULL, 0x775ea264cf55347eULL},
+	{0xc612062576589ddaULL, 0x95364afe032a819eULL},
+	{0xf79687aed3eec551ULL, 0x3a83ddbd83f52205ULL},
+	{0x9abe14cd44753b52ULL, 0xc4926a9672793543ULL},
+	{0xc16d9a0095928a27ULL, 0x75b7053c0f178294ULL},
+	{0xf1c90080baf72cb1ULL, 0x5324c68b12dd6339ULL},
+	{0x971da05074da7beeULL, 0xd3f6fc16ebca5e04ULL},
+	{0xbce5086492111aeaULL, 0x88f4bb1ca6bcf585ULL},
+	{0xec1e4a7db69561a5ULL, 0x2b31e9e3d06c32e6ULL},
+	{0x9392ee8e921d5d07ULL, 0x3aff322e62439fd0ULL},
+	{0xb877aa3236a4b449ULL, 0x09befeb9fad487c3ULL},
+	{0xe69594bec44de15bULL, 0x4c2ebe687989a9b4ULL},
+	{0x901d7cf73ab0acd9ULL, 0x0f9d37014bf60a11ULL},
+	{0xb424dc35095cd80fULL, 0x538484c19ef38c95ULL},
+	{0xe12e13424bb40e13ULL, 0x2865a5f206b06fbaULL},
+	{0x8cbccc096f5088cbULL, 0xf93f87b7442e45d4ULL},
+	{0xafebff0bcb24aafeULL, 0xf78f69a51539d749ULL},
+	{0xdbe6fecebdedd5beULL, 0xb573440e5a884d1cULL},
+	{0x89705f4136b4a597ULL, 0x31680a88f8953031ULL},
+	{0xabcc77118461cefcULL, 0xfdc20d2b36ba7c3eULL},
+	{0xd6bf94d5e57a42bcULL, 0x3d32907604691b4dULL},
+	{0x8637bd05af6c69b5ULL, 0xa63f9a49c2c1b110ULL},
+	{0xa7c5ac471b478423ULL, 0x0fcf80dc33721d54ULL},
+	{0xd1b71758e219652bULL, 0xd3c36113404ea4a9ULL},
+	{0x83126e978d4fdf3bULL, 0x645a1cac083126eaULL},
+	{0xa3d70a3d70a3d70aULL, 0x3d70a3d70a3d70a4ULL},
+	{0xccccccccccccccccULL, 0xcccccccccccccccdULL},
+	{0x8000000000000000ULL, 0x0000000000000000ULL},
+	{0xa000000000000000ULL, 0x0000000000000000ULL},
+	{0xc800000000000000ULL, 0x0000000000000000ULL},
+	{0xfa00000000000000ULL, 0x0000000000000000ULL},
+	{0x9c40000000000000ULL, 0x0000000000000000ULL},
+	{0xc350000000000000ULL, 0x0000000000000000ULL},
+	{0xf424000000000000ULL, 0x0000000000000000ULL},
+	{0x9896800000000000ULL, 0x0000000000000000ULL},
+	{0xbebc200000000000ULL, 0x0000000000000000ULL},
+	{0xee6b280000000000ULL, 0x0000000000000000ULL},
+	{0x9502f90000000000ULL, 0x0000000000000000ULL},
+	{0xba43b74000000000ULL, 0x0000000000000000ULL},
+	{0xe8d4a51000000000ULL, 0x0000000000000000ULL},
+	{0x9184e72a00000000ULL, 0x0000000000000000ULL},
+	{0xb5e620f480000000ULL, 0x0000000000000000ULL},
+	{0xe35fa931a0000000ULL, 0x0000000000000000ULL},
+	{0x8e1bc9bf04000000ULL, 0x0000000000000000ULL},
+	{0xb1a2bc2ec5000000ULL, 0x0000000000000000ULL},
+	{0xde0b6b3a76400000ULL, 0x0000000000000000ULL},
+	{0x8ac7230489e80000ULL, 0x0000000000000000ULL},
+	{0xad78ebc5ac620000ULL, 0x0000000000000000ULL},
+	{0xd8d726b7177a8000ULL, 0x0000000000000000ULL},
+	{0x878678326eac9000ULL, 0x0000000000000000ULL},
+	{0xa968163f0a57b400ULL, 0x0000000000000000ULL},
+	{0xd3c21bcecceda100ULL, 0x0000000000000000ULL},
+	{0x84595161401484a0ULL, 0x0000000000000000ULL},
+	{0xa56fa5b99019a5c8ULL, 0x0000000000000000ULL},
+	{0xcecb8f27f4200f3aULL, 0x0000000000000000ULL},
+	{0x813f3978f8940984ULL, 0x4000000000000000ULL},
+	{0xa18f07d736b90be5ULL, 0x5000000000000000ULL},
+	{0xc9f2c9cd04674edeULL, 0xa400000000000000ULL},
+	{0xfc6f7c4045812296ULL, 0x4d00000000000000ULL},
+	{0x9dc5ada82b70b59dULL, 0xf020000000000000ULL},
+	{0xc5371912364ce305ULL, 0x6c28000000000000ULL},
+	{0xf684df56c3e01bc6ULL, 0xc732000000000000ULL},
+	{0x9a130b963a6c115cULL, 0x3c7f400000000000ULL},
+	{0xc097ce7bc90715b3ULL, 0x4b9f100000000000ULL},
+	{0xf0bdc21abb48db20ULL, 0x1e86d40000000000ULL},
+	{0x96769950b50d88f4ULL, 0x1314448000000000ULL},
+	{0xbc143fa4e250eb31ULL, 0x17d955a000000000ULL},
+	{0xeb194f8e1ae525fdULL, 0x5dcfab0800000000ULL},
+	{0x92efd1b8d0cf37beULL, 0x5aa1cae500000000ULL},
+	{0xb7abc627050305adULL, 0xf14a3d9e40000000ULL},
+	{0xe596b7b0c643c719ULL, 0x6d9ccd05d0000000ULL},
+	{0x8f7e32ce7bea5c6fULL, 0xe4820023a2000000ULL},
+	{0xb35dbf821ae4f38bULL, 0xdda2802c8a800000ULL},
+	{0xe0352f62a19e306eULL, 0xd50b2037ad200000ULL},
+	{0x8c213d9da502de45ULL, 0x4526f422cc340000ULL},
+	{0xaf298d050e4395d6ULL, 0x9670b12b7f410000ULL},
+	{0xdaf3f04651d47b4cULL, 0x3c0cdd765f114000ULL},
+	{0x88d8762bf324cd0fULL, 0xa5880a69fb6ac800ULL},
+	{0xab0e93b6efee0053ULL, 0x8eea0d047a457a00ULL},
+	{0xd5d238a4abe98068ULL, 0x72a4904598d6d880ULL},
+	{0x85a36366eb71f041ULL, 0x47a6da2b7f864750ULL},
+	{0xa70c3c40a64e6c51ULL, 0x999090b65f67d924ULL},
+	{0xd0cf4b50cfe20765ULL, 0xfff4b4e3f741cf6dULL},
+	{0x82818f1281ed449fULL, 0xbff8f10e7a8921a4ULL},
+	{0xa321f2d7226895c7ULL, 0xaff72d52192b6a0dULL},
+	{0xcbea6f8ceb02bb39ULL, 0x9bf4f8a69f764490ULL},
+	{0xfee50b7025c36a08ULL, 0x02f236d04753d5b4ULL},
+	{0x9f4f2726179a2245ULL, 0x01d762422c946590ULL},
+	{0xc722f0ef9d80aad6ULL, 0x424d3ad2b7b97ef5ULL},
+	{0xf8ebad2b84e0d58bULL, 0xd2e0898765a7deb2ULL},
+	{0x9b934c3b330c8577ULL, 0x63cc55f49f88eb2fULL},
+	{0xc2781f49ffcfa6d5ULL, 0x3cbf6b71c76b25fbULL},
+};
+
+/*
+Writes `x` to `buffer` of at least NUMBER_BUFFER_SIZE bytes in notation
+readable back by the reader. Returns length without terminating null.
+
+Like in JavaScript, numbers from 1e-6 to below 1e21 are written in positional
+notation and others with an exponent, like `1e300` or `2.5e-7`.
+*/
+size_t
+number_format(double x, char *buffer)
+{
+	int k,
+		point;
+	size_t length,
+		i = 0;
+	char digits[32];
+
+	if (isnan(x)) {
+		strcpy(buffer, signbit(x) ? "-nan" : "nan");
+		return strlen(buffer);
+	} else if (signbit(x)) {
+		buffer[i++] = '-';
+		x = -x;
+	}
+
+	if (isinf(x)) {
+		strcpy(buffer + i, "inf");
+		return i + 3;
+	} else if (x < NUMBER_INTEGER_MAX && x == (uint64_t)x) {
+		/* Fast path of integers, which are exact */
+		return i + number_uint_format((uint64_t)x, buffer + i);
+	}
+
+	/* Digits of `digits * 10^k` are placed around the point */
+	length = number_grisu(x, digits, &k);
+	point = (int)length + k;
+	if (point < NUMBER_POINT_MIN || point > NUMBER_POINT_MAX) {
+		buffer[i++] = digits[0];
+		if (length > 1) {
+			buffer[i++] = '.';
+			memcpy(buffer + i, digits + 1, length - 1);
+			i += length - 1;
+		}
+		buffer[i++] = 'e';
+		if (point - 1 < 0)
+			buffer[i++] = '-';
+		i += number_uint_format(abs(point - 1), buffer + i);
+	} else if (k >= 0) {
+		memcpy(buffer + i, digits, length);
+		i += length;
+		memset(buffer + i, '0', k);
+		i += k;
+	} else if (point > 0) {
+		memcpy(buffer + i, digits, point);
+		i += point;
+		buffer[i++] = '.';
+		memcpy(buffer + i, digits + point, length - point);
+		i += length - point;
+	} else {
+		buffer[i++] = '0';
+		buffer[i++] = '.';
+		memset(buffer + i, '0', -point);
+		i += -point;
+		memcpy(buffer + i, digits, length);
+		i += length;
+	}
+	buffer[i] = '\0';
+	return i;
+}
+
+/*
+Parses `s` matched by the Number grammar to `x`. Returns 0 if the number is
+too large for doubles. Too small one is rounded to a subnormal or zero.
+*/
+unsigned char
+number_parse(const char *s, double *x)
+{
+	const char *start = s;
+	int digits = 0,
+		q = 0,
+		exponent = 0;
+	unsigned char negative = 0,
+		negative_exponent = 0,
+		truncated = 0;
+	uint64_t w = 0;
+	double y;
+
+	if (*s == '-') {
+		negative = 1;
+		++s;
+	}
+
+	/* Collect significant digits and exponent of the dropped or fractional */
+	while (*s == '0')
+		++s;
+	for (; *s >= '0' && *s <= '9'; ++s) {
+		if (digits < NUMBER_SIGNIFICANT_DIGITS) {
+			w = w * 10 + (*s - '0');
+			++digits;
+		} else {
+			++q;
+			truncated |= *s != '0';
+		}
+	}
+	if (*s == '.') {
+		for (++s; digits == 0 && *s == '0'; ++s)
+			--q;
+		for (; *s >= '0' && *s <= '9'; ++s) {
+			if (digits < NUMBER_SIGNIFICANT_DIGITS) {
+				w = w * 10 + (*s - '0');
+				++digits;
+				--q;
+			} else {
+				truncated |= *s != '0';
+			}
+		}
+	}
+	if (*s == 'e' || *s == 'E') {
+		/* Exponent beyond the limit only overflows or underflows */
+		++s;
+		if (*s == '-' || *s == '+')
+			negative_exponent = *s++ == '-';
+		for (; *s >= '0' && *s <= '9'; ++s)
+			if (exponent < NUMBER_LITERAL_EXPONENT_MAX)
+				exponent = exponent * 10 + (*s - '0');
+		q += negative_exponent ? -exponent : exponent;
+	}
+
+	if (w == 0) {
+		*x = 0.0;
+	} else if (
+		!truncated
+		&& w <= (uint64_t)1 << 53
+		&& q >= -NUMBER_FAST_EXPONENT_MAX
+		&& q <= NUMBER_FAST_EXPONENT_MAX
+	) {
+		/* Both operands are exact, so is the rounded result */
+		*x = (double)w;
+		if (q < 0)
+			*x /= number_exact_powers_10[-q];
+		else
+			*x *= number_exact_powers_10[q];
+	} else if (
+		!number_lemire(w, q, x)
+		|| (truncated && (!number_lemire(w + 1, q, &y) || *x != y))
+	) {
+		/* Digits after truncated ones may change rounding */
+		errno = 0;
+		*x = strtod(start, NULL);
+		return errno != ERANGE || !isinf(*x);
+	}
+
+	if (negative)
+		*x = -*x;
+	return 1;
+}
+
+/* Computes boundaries of halfway to neighbour doubles with common exponent. */
+static void
+number_boundaries(double x, NumberFp *minus, NumberFp *plus)
+{
+	NumberFp v = number_fp(x);
+
+	plus->f = (v.f << 1) + 1;
+	plus->e = v.e - 1;
+	while (!(plus->f & (NUMBER_HIDDEN_BIT << 1))) {
+		plus->f <<= 1;
+		--plus->e;
+	}
+	plus->f <<= 64 - NUMBER_SIGNIFICAND_SIZE - 2;
+	plus->e -= 64 - NUMBER_SIGNIFICAND_SIZE - 2;
+
+	/* Lower neighbour is closer at powers of two */
+	if (v.f == NUMBER_HIDDEN_BIT) {
+		minus->f = (v.f << 2) - 1;
+		minus->e = v.e - 2;
+	} else {
+		minus->f = (v.f << 1) - 1;
+		minus->e = v.e - 1;
+	}
+	minus->f <<= minus->e - plus->e;
+	minus->e = plus->e;
+}
+
+/* Returns cached power 10^-k, so that exponent of product is in [-60, -32]. */
+static NumberFp
+number_cached_power(int e, int *k)
+{
+	int i;
+	double dk = (-61 - e) * 0.30102999566398114 + 347;
+	NumberFp rv;
+
+	i = (int)dk;
+	if (dk - i > 0.0)
+		++i;
+	i = (i >> 3) + 1;
+	*k = -(-348 + i * 8);
+	rv.f = number_powers_f[i];
+	rv.e = number_powers_e[i];
+	return rv;
+}
+
+/*
+Generates shortest digits of `w` in range `mp - delta` to `mp`. Decimal
+exponent `k` is adjusted for them.
+*/
+static size_t
+number_digits(NumberFp w, NumberFp mp, uint64_t delta, char *digits, int *k)
+{
+	int kappa = 10;
+	uint32_t d,
+		p1;
+	uint64_t p2,
+		rest,
+		one_f = (uint64_t)1 << -mp.e,
+		wp_w = mp.f - w.f;
+	size_t length = 0;
+
+	/* Split to integral and fractional parts */
+	p1 = (uint32_t)(mp.f >> -mp.e);
+	p2 = mp.f & (one_f - 1);
+	while (kappa > 1 && p1 < number_powers_10[kappa - 1])
+		--kappa;
+
+	while (kappa > 0) {
+		d = (uint32_t)(p1 / number_powers_10[kappa - 1]);
+		p1 %= number_powers_10[kappa - 1];
+		if (d || length)
+			digits[length++] = '0' + d;
+		--kappa;
+		rest = ((uint64_t)p1 << -mp.e) + p2;
+		if (rest <= delta) {
+			*k += kappa;
+			number_round(
+				digits,
+				length,
+				delta,
+				rest,
+				number_powers_10[kappa] << -mp.e,
+				wp_w
+			);
+			return length;
+		}
+	}
+
+	while (1) {
+		p2 *= 10;
+		delta *= 10;
+		d = (uint32_t)(p2 >> -mp.e);
+		if (d || length)
+			digits[length++] = '0' + d;
+		p2 &= one_f - 1;
+		--kappa;
+		if (p2 < delta) {
+			*k += kappa;
+			number_round(
+				digits,
+				length,
+				delta,
+				p2,
+				one_f,
+				-kappa < 20 ? wp_w * number_powers_10[-kappa] : 0
+			);
+			return length;
+		}
+	}
+}
+
+static NumberFp
+number_fp(double x)
+{
+	uint64_t bits;
+	int biased;
+	NumberFp rv;
+
+	memcpy(&bits, &x, sizeof(bits));
+	biased = (int)(bits >> NUMBER_SIGNIFICAND_SIZE) & 0x7ff;
+	rv.f = bits & NUMBER_SIGNIFICAND_MASK;
+	if (biased) {
+		rv.f += NUMBER_HIDDEN_BIT;
+		rv.e = biased - NUMBER_EXPONENT_BIAS;
+	} else {
+		/* Subnormal */
+		rv.e = 1 - NUMBER_EXPONENT_BIAS;
+	}
+	return rv;
+}
+
+/* Writes shortest digits of positive `x` equal to `digits * 10^k`. */
+static size_t
+number_grisu(double x, char *digits, int *k)
+{
+	NumberFp c,
+		minus,
+		plus,
+		w;
+
+	number_boundaries(x, &minus, &plus);
+	c = number_cached_power(plus.e, k);
+	w = number_multiply(number_normalize(number_fp(x)), c);
+	plus = number_multiply(plus, c);
+	minus = number_multiply(minus, c);
+
+	/* Shrink the range by unit of imprecision of multiplication */
+	++minus.f;
+	--plus.f;
+	return number_digits(w, plus, plus.f - minus.f, digits, k);
+}
+
+/*
+Computes `w * 10^q` rounded to nearest even. Returns 0 if the product isn't
+precise enough to round or `q` is out of the table.
+*/
+static unsigned char
+number_lemire(uint64_t w, int q, double *x)
+{
+	int lz = 0,
+		upper,
+		shift,
+		power2;
+	uint64_t high,
+		high2,
+		low,
+		mantissa;
+	const uint64_t *power;
+
+	if (q < NUMBER_POWERS_5_MIN || q > NUMBER_POWERS_5_MAX)
+		return 0;
+	power = number_powers_5[q - NUMBER_POWERS_5_MIN];
+	while (!(w & ((uint64_t)1 << 63))) {
+		w <<= 1;
+		++lz;
+	}
+
+	/* Upper 64 bits of 192-bit product are enough unless 9 bits are ones */
+	low = number_product(w, power[0], &high);
+	if ((high & 0x1ff) == 0x1ff) {
+		number_product(w, power[1], &high2);
+		low += high2;
+		if (high2 > low)
+			++high;
+		if ((high & 0x1ff) == 0x1ff && low + 1 == 0 && (q < -27 || q > 55))
+			return 0;
+	}
+
+	/* Keep 54 bits, one for rounding */
+	upper = (int)(high >> 63);
+	shift = upper + 64 - NUMBER_SIGNIFICAND_SIZE - 3;
+	mantissa = high >> shift;
+	power2 = (((152170 + 65536) * q) >> 16) + 63 + upper - lz + 1023;
+
+	/* Product is exactly halfway, round to even */
+	if (
+		low <= 1
+		&& q >= -4
+		&& q <= 23
+		&& (mantissa & 3) == 1
+		&& (mantissa << shift) == high
+	)
+		mantissa &= ~(uint64_t)1;
+	mantissa += mantissa & 1;
+	mantissa >>= 1;
+	if (mantissa >= (uint64_t)2 << NUMBER_SIGNIFICAND_SIZE) {
+		mantissa = (uint64_t)1 << NUMBER_SIGNIFICAND_SIZE;
+		++power2;
+	}
+
+	/* Table range keeps the result normal and finite */
+	mantissa &= ~NUMBER_HIDDEN_BIT;
+	mantissa |= (uint64_t)power2 << NUMBER_SIGNIFICAND_SIZE;
+	memcpy(x, &mantissa, sizeof(*x));
+	return 1;
+}
+
+/* Multiplies rounding the lower 64 bits of the product. */
+static NumberFp
+number_multiply(NumberFp x, NumberFp y)
+{
+	uint64_t a = x.f >> 32,
+		b = x.f & 0xffffffff,
+		c = y.f >> 32,
+		d = y.f & 0xffffffff,
+		ac = a * c,
+		bc = b * c,
+		ad = a * d,
+		bd = b * d,
+		tmp = (bd >> 32) + (ad & 0xffffffff) + (bc & 0xffffffff);
+	NumberFp rv;
+
+	tmp += (uint64_t)1 << 31;
+	rv.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+	rv.e = x.e + y.e + 64;
+	return rv;
+}
+
+static NumberFp
+number_normalize(NumberFp x)
+{
+	while (!(x.f & ((uint64_t)1 << 63))) {
+		x.f <<= 1;
+		--x.e;
+	}
+	return x;
+}
+
+/* Computes 128-bit product of `x` and `y`. Returns its lower half. */
+static uint64_t
+number_product(uint64_t x, uint64_t y, uint64_t *high)
+{
+	uint64_t a = x >> 32,
+		b = x & 0xffffffff,
+		c = y >> 32,
+		d = y & 0xffffffff,
+		ac = a * c,
+		bc = b * c,
+		ad = a * d,
+		bd = b * d,
+		middle = (bd >> 32) + (ad & 0xffffffff) + (bc & 0xffffffff);
+
+	*high = ac + (ad >> 32) + (bc >> 32) + (middle >> 32);
+	return (middle << 32) | (bd & 0xffffffff);
+}
+
+/* Moves the last digit closer to `w` while it stays in the range. */
+static void
+number_round(
+	char *digits,
+	size_t length,
+	uint64_t delta,
+	uint64_t rest,
+	uint64_t ten_kappa,
+	uint64_t wp_w
+)
+{
+	while (
+		rest < wp_w
+		&& delta - rest >= ten_kappa
+		&& (
+			rest + ten_kappa < wp_w
+			|| wp_w - rest > rest + ten_kappa - wp_w
+		)
+	) {
+		--digits[length - 1];
+		rest += ten_kappa;
+	}
+}
+
+static size_t
+number_uint_format(uint64_t n, char *buffer)
+{
+	size_t i,
+		length = 0;
+	char c;
+
+	do {
+		buffer[length++] = '0' + n % 10;
+		n /= 10;
+	} while (n);
+
+	/* Digits were written from the lowest */
+	for (i = 0; i < length / 2; ++i) {
+		c = buffer[i];
+		buffer[i] = buffer[length - 1 - i];
+		buffer[length - 1 - i] = c;
+	}
+	buffer[length] = '\0';
+	return length;
+}
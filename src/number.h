@@ -0,0 +1,18 @@
+#ifndef _NUMBER_H
+#define _NUMBER_H
+
+#include <stdlib.h>
+
+/*
+Enough for the longest notation of a double: sign, "0." and 5 zeros before 17
+digits
+*/
+#define NUMBER_BUFFER_SIZE (32)
+
+/* Integers below are exact and printed without fractional part */
+#define NUMBER_INTEGER_MAX (9007199254740992.0)
+
+size_t number_format(double, char *);
+unsigned char number_parse(const char *, double *);
+
+#endif /* _NUMBER_H */
@@ -0,0 +1,621 @@
+#include <string.h>
+#include "config.h"
+#include "optimize.h"
+
+/*
+Optional pass over read code, which runs before evaluation:
+
+- Folds arithmetic, comparison and logic builtins applied to constants.
+- Inlines small non-recursive global lambdas at call sites.
+
+Code is optimized only in evaluated positions: top level expressions, bodies
+of lambdas and `fun`, branches of `if` and `while`. Rewritten code keeps the
+original one and falls back to it if a global it relies on is redefined.
+
+Symbols bound by enclosing formals or `=` are never treated as globals.
+*/
+
+unsigned char optimize_enabled = 0;
+unsigned char optimize_dump = 0;
+
+typedef struct OptimizeScope OptimizeScope;
+struct OptimizeScope {
+	const OptimizeScope *parent;
+
+	/* Qexpression of locally bound symbols */
+	const Value *symbols;
+};
+
+static Value *optimize_body(
+	Value *body,
+	Env *env,
+	const Value *formals,
+	size_t formals_skip,
+	const OptimizeScope *scope,
+	size_t depth
+);
+static ValueBuiltin optimize_builtin(const EnvEntry *entry);
+static void optimize_collect_locals(const Value *code, Value *locals);
+static void optimize_count(
+	const Value *code,
+	const char *symbol,
+	size_t *evaluated,
+	size_t *quoted
+);
+static unsigned char optimize_eager(
+	const Value *code,
+	const Value *formals,
+	const Value *call,
+	unsigned char lazy
+);
+static Value *optimize_expression(
+	Value *value,
+	Env *env,
+	const OptimizeScope *scope,
+	size_t depth
+);
+static Value *optimize_fold(Value *value, Env *env, EnvEntry *entry);
+static unsigned char optimize_foldable(ValueBuiltin builtin);
+static EnvEntry *optimize_global(
+	const Value *symbol,
+	const Env *env,
+	const OptimizeScope *scope
+);
+static Value *optimize_guard(Value *value, Value *origin, EnvEntry *entry);
+static unsigned char optimize_hygienic(
+	const Value *code,
+	const Value *formals,
+	const Env *captured,
+	const OptimizeScope *scope
+);
+static Value *optimize_inline(
+	Value *value,
+	Env *env,
+	EnvEntry *entry,
+	const OptimizeScope *scope,
+	size_t depth
+);
+static unsigned char optimize_inlinable(const Value *f, const Value *call);
+static unsigned char optimize_ordered(
+	const Value *code,
+	const Value *formals,
+	size_t *next
+);
+static size_t optimize_size(const Value *code);
+static Value *optimize_substitute(
+	const Value *code,
+	const Value *formals,
+	const Value *call
+);
+
+/* Optimizes top level expression `value` evaluated in `env`. */
+Value*
+optimize(Value *value, Env *env)
+{
+	value = optimize_expression(value, env, NULL, 0);
+	if (optimize_dump)
+		value_println(value);
+	return value;
+}
+
+/*
+Optimizes qexpression `body` evaluated as sexpression with `formals` bound.
+First `formals_skip` formals are not bound.
+*/
+static Value*
+optimize_body(
+	Value *body,
+	Env *env,
+	const Value *formals,
+	size_t formals_skip,
+	const OptimizeScope *scope,
+	size_t depth
+)
+{
+	size_t i;
+	OptimizeScope body_scope;
+	Value *locals = value_expression_alloc(QEXPRESSION_TYPE),
+		*rv;
+
+	/* Collect symbols which shadow globals in the body */
+	body = value_own(body);
+	for (i = formals_skip; formals && i < formals->children_count; ++i)
+		value_add_child(locals, value_copy(formals->children[i]));
+	optimize_collect_locals(body, locals);
+	body_scope.parent = scope;
+	body_scope.symbols = locals;
+
+	body->type = SEXPRESSION_TYPE;
+	body->hashed = 0;
+	body = optimize_expression(body, env, &body_scope, depth);
+	value_free(locals);
+
+	if (body->type == SEXPRESSION_TYPE) {
+		body->type = QEXPRESSION_TYPE;
+		return body;
+	}
+
+	/* Body was folded to a constant, which is evaluated to itself */
+	rv = value_expression_alloc(QEXPRESSION_TYPE);
+	value_add_child(rv, body);
+	return rv;
+}
+
+static ValueBuiltin
+optimize_builtin(const EnvEntry *entry)
+{
+	if (entry->value->type != FUNCTION_TYPE || entry->value->memo)
+		return NULL;
+	return entry->value->builtin;
+}
+
+/* Adds symbols assigned with `=` anywhere in `code` to `locals`. */
+static void
+optimize_collect_locals(const Value *code, Value *locals)
+{
+	size_t i;
+	const Value *symbols;
+
+	if (code->type != SEXPRESSION_TYPE && code->type != QEXPRESSION_TYPE)
+		return;
+
+	if (
+		code->children_count >= 2
+		&& code->children[0]->type == SYMBOL_TYPE
+		&& strcmp(code->children[0]->symbol, "=") == 0
+		&& code->children[1]->type == QEXPRESSION_TYPE
+	) {
+		symbols = code->children[1];
+		for (i = 0; i < symbols->children_count; ++i)
+			if (symbols->children[i]->type == SYMBOL_TYPE)
+				value_add_child(locals, value_copy(symbols->children[i]));
+	}
+
+	for (i = 0; i < code->children_count; ++i)
+		optimize_collect_locals(code->children[i], locals);
+}
+
+/*
+Counts occurrences of `symbol` in `code`, which is evaluated as sexpression,
+separately for evaluated and quoted positions.
+*/
+static void
+optimize_count(
+	const Value *code,
+	const char *symbol,
+	size_t *evaluated,
+	size_t *quoted
+)
+{
+	size_t i;
+
+	if (code->type == SYMBOL_TYPE && strcmp(code->symbol, symbol) == 0) {
+		++*evaluated;
+	} else if (code->type == SEXPRESSION_TYPE) {
+		for (i = 0; i < code->children_count; ++i)
+			optimize_count(code->children[i], symbol, evaluated, quoted);
+	} else if (code->type == QEXPRESSION_TYPE) {
+		/* Everything inside of quoted code is counted as quoted */
+		for (i = 0; i < code->children_count; ++i)
+			optimize_count(code->children[i], symbol, quoted, quoted);
+	}
+}
+
+/*
+Checks that formals of `code` whose arguments in `call` aren't constants are
+in positions evaluated on every evaluation of `code`. Special forms like `&&`,
+`if`, `select` and `case` skip some of their arguments, so an inlined argument
+there could lose its side effects or errors. `lazy` is set inside of such
+position.
+*/
+static unsigned char
+optimize_eager(
+	const Value *code,
+	const Value *formals,
+	const Value *call,
+	unsigned char lazy
+)
+{
+	size_t i,
+		skipped = code->children_count;
+	const Value *head,
+		*arg;
+
+	if (code->type == SYMBOL_TYPE && lazy) {
+		for (i = 0; i < formals->children_count; ++i) {
+			if (strcmp(formals->children[i]->symbol, code->symbol) != 0)
+				continue;
+			arg = call->children[i + 1];
+			return arg->type == NUMBER_TYPE
+				|| arg->type == STRING_TYPE
+				|| arg->type == QEXPRESSION_TYPE;
+		}
+	} else if (code->type == SEXPRESSION_TYPE) {
+		/* Find the first argument which may be skipped */
+		head = code->children_count ? code->children[0] : NULL;
+		if (head && head->type == SYMBOL_TYPE && head->builtin) {
+			if (
+				head->builtin == value_symbol_and_eval
+				|| head->builtin == value_symbol_or_eval
+				|| head->builtin == value_symbol_if_eval
+				|| head->builtin == value_symbol_select_eval
+			)
+				skipped = 2;
+			else if (head->builtin == value_symbol_case_eval)
+				skipped = 3;
+		}
+		for (i = 0; i < code->children_count; ++i)
+			if (
+				!optimize_eager(
+					code->children[i],
+					formals,
+					call,
+					lazy || i >= skipped
+				)
+			)
+				return 0;
+	}
+	return 1;
+}
+
+static Value*
+optimize_expression(
+	Value *value,
+	Env *env,
+	const OptimizeScope *scope,
+	size_t depth
+)
+{
+	size_t i;
+	ValueBuiltin builtin = NULL;
+	EnvEntry *entry = NULL;
+	Value *head,
+		*child;
+	unsigned char fun;
+
+	if (value->type != SEXPRESSION_TYPE || value->children_count == 0)
+		return value;
+	value = value_own(value);
+	value->hashed = 0;
+
+	/* Resolve global called by the expression */
+	head = value->children[0];
+	if (head->type == SYMBOL_TYPE)
+		entry = optimize_global(head, env, scope);
+	else
+		value->children[0] = optimize_expression(head, env, scope, depth);
+	if (entry)
+		builtin = optimize_builtin(entry);
+	fun = entry && !builtin && strcmp(head->symbol, "fun") == 0;
+
+	for (i = 1; i < value->children_count; ++i) {
+		child = value->children[i];
+		if (child->type != QEXPRESSION_TYPE) {
+			value->children[i] = optimize_expression(child, env, scope, depth);
+		} else if (
+			i == 2
+			&& (builtin == value_symbol_lambda_eval || fun)
+			&& value->children[1]->type == QEXPRESSION_TYPE
+		) {
+			/* Lambda's body. `fun` has function name before formals */
+			value->children[i] = optimize_body(
+				child,
+				env,
+				value->children[1],
+				fun ? 1 : 0,
+				scope,
+				depth
+			);
+		} else if (
+			(builtin == value_symbol_if_eval && (i == 2 || i == 3))
+			|| (builtin == value_symbol_while_eval && (i == 1 || i == 2))
+		) {
+			/* Branches and loops are evaluated in the same scope */
+			value->children[i] = optimize_body(
+				child,
+				env,
+				NULL,
+				0,
+				scope,
+				depth
+			);
+		}
+	}
+
+	/* Single child is evaluated to itself without a call */
+	if (!entry || value->children_count < 2)
+		return value;
+	else if (optimize_foldable(builtin))
+		return optimize_fold(value, env, entry);
+	else if (!builtin && depth < OPTIMIZE_INLINE_MAX_DEPTH)
+		return optimize_inline(value, env, entry, scope, depth);
+	return value;
+}
+
+/* Replaces call of pure builtin with constant arguments by its result. */
+static Value*
+optimize_fold(Value *value, Env *env, EnvEntry *entry)
+{
+	size_t i;
+	Value *result;
+	ValueBuiltin builtin = entry->value->builtin;
+	unsigned char cmp = builtin == value_symbol_eq_eval
+		|| builtin == value_symbol_ne_eval;
+
+	for (i = 1; i < value->children_count; ++i)
+		if (
+			value->children[i]->type != NUMBER_TYPE
+			&& !(cmp && value->children[i]->type == STRING_TYPE)
+		)
+			return value;
+
+	/* Errors like division by zero are left to the runtime */
+	result = value_eval(value, env);
+	if (result->type != NUMBER_TYPE) {
+		value_free(result);
+		return value;
+	}
+	return optimize_guard(result, value, entry);
+}
+
+static unsigned char
+optimize_foldable(ValueBuiltin builtin)
+{
+	return builtin == value_symbol_add_eval
+		|| builtin == value_symbol_substract_eval
+		|| builtin == value_symbol_multiply_eval
+		|| builtin == value_symbol_divide_eval
+		|| builtin == value_symbol_eq_eval
+		|| builtin == value_symbol_ne_eval
+		|| builtin == value_symbol_gt_eval
+		|| builtin == value_symbol_ge_eval
+		|| builtin == value_symbol_lt_eval
+		|| builtin == value_symbol_le_eval
+		|| builtin == value_symbol_not_eval
+		|| builtin == value_symbol_and_eval
+		|| builtin == value_symbol_or_eval;
+}
+
+/* Returns global entry of `symbol` if it's not bound in `scope` or `env`. */
+static EnvEntry*
+optimize_global(const Value *symbol, const Env *env, const OptimizeScope *scope)
+{
+	size_t i;
+
+	for (; scope; scope = scope->parent)
+		for (i = 0; i < scope->symbols->children_count; ++i)
+			if (strcmp(scope->symbols->children[i]->symbol, symbol->symbol) == 0)
+				return NULL;
+	return env_get_global_entry(env, symbol);
+}
+
+/* Makes `origin` to be evaluated instead of `value` if `entry` changes. */
+static Value*
+optimize_guard(Value *value, Value *origin, EnvEntry *entry)
+{
+	Value *wrapper;
+
+	/*
+	Sexpression of single child is evaluated to the child, so it can hold
+	another guard
+	*/
+	if (value->origin) {
+		wrapper = value_expression_alloc(SEXPRESSION_TYPE);
+		value_add_child(wrapper, value);
+		value = wrapper;
+	}
+
+	/* Rewritten code was already optimized. Keep its guard outside */
+	if (origin->origin) {
+		wrapper = value_expression_alloc(SEXPRESSION_TYPE);
+		wrapper->origin = origin->origin;
+		wrapper->guard = origin->guard;
+		wrapper->guard_version = origin->guard_version;
+		origin->origin = NULL;
+		value_add_child(wrapper, optimize_guard(value, origin, entry));
+		return wrapper;
+	}
+
+	value->origin = origin;
+	value->guard = entry;
+	value->guard_version = entry->version;
+	return value;
+}
+
+/*
+Checks that symbols of inlined `code` other than `formals` are bound neither
+in frames `captured` by the lambda nor in `scope` of the call site, so they
+resolve to the same globals after inlining. Lambdas defined by `fun` capture
+its frame, which binds none of them usually.
+*/
+static unsigned char
+optimize_hygienic(
+	const Value *code,
+	const Value *formals,
+	const Env *captured,
+	const OptimizeScope *scope
+)
+{
+	size_t i;
+
+	if (code->type == SYMBOL_TYPE) {
+		for (i = 0; i < formals->children_count; ++i)
+			if (strcmp(formals->children[i]->symbol, code->symbol) == 0)
+				return 1;
+		if (env_shadows(captured, code))
+			return 0;
+		for (; scope; scope = scope->parent)
+			for (i = 0; i < scope->symbols->children_count; ++i)
+				if (strcmp(scope->symbols->children[i]->symbol, code->symbol) == 0)
+					return 0;
+	} else if (code->type == SEXPRESSION_TYPE || code->type == QEXPRESSION_TYPE) {
+		for (i = 0; i < code->children_count; ++i)
+			if (!optimize_hygienic(code->children[i], formals, captured, scope))
+				return 0;
+	}
+	return 1;
+}
+
+/* Replaces call of a small global lambda by lambda's body. */
+static Value*
+optimize_inline(
+	Value *value,
+	Env *env,
+	EnvEntry *entry,
+	const OptimizeScope *scope,
+	size_t depth
+)
+{
+	Value body,
+		*rv;
+
+	if (
+		!optimize_inlinable(entry->value, value)
+		|| !optimize_hygienic(
+			entry->value->lambda->body,
+			entry->value->lambda->formals,
+			entry->value->env,
+			scope
+		)
+	)
+		return value;
+
+	body = *entry->value->lambda->body;
+	body.type = SEXPRESSION_TYPE;
+	rv = optimize_substitute(&body, entry->value->lambda->formals, value);
+	rv = optimize_expression(rv, env, scope, depth + 1);
+	return optimize_guard(rv, value, entry);
+}
+
+/*
+Checks that lambda `f` can be inlined at `call`: it is small, doesn't refer to
+itself, doesn't assign locals and every formal is evaluated exactly once. If
+any argument isn't a constant or a symbol, the formals must be evaluated in
+order before any call in the body finishes to keep side effects in order.
+Arguments other than constants can't be skipped by special forms.
+*/
+static unsigned char
+optimize_inlinable(const Value *f, const Value *call)
+{
+	size_t i,
+		evaluated,
+		quoted,
+		next = 0;
+	unsigned char simple = 1;
+	const Value *formals;
+	Value body;
+
+	if (
+		f->type != FUNCTION_TYPE
+		|| f->builtin
+		|| f->memo
+		|| f->record_function
+	)
+		return 0;
+
+	/* Body is evaluated as sexpression */
+	formals = f->lambda->formals;
+	body = *f->lambda->body;
+	body.type = SEXPRESSION_TYPE;
+
+	if (
+		formals->children_count != call->children_count - 1
+		|| body.children_count == 0
+		|| optimize_size(&body) > OPTIMIZE_INLINE_MAX_SIZE
+	)
+		return 0;
+
+	/* Partially applied lambda has bound arguments */
+	if (f->lambda_args)
+		return 0;
+
+	/* Recursion and local assignments */
+	evaluated = quoted = 0;
+	optimize_count(&body, call->children[0]->symbol, &evaluated, &quoted);
+	optimize_count(&body, "=", &evaluated, &quoted);
+	if (evaluated + quoted != 0)
+		return 0;
+
+	for (i = 0; i < formals->children_count; ++i) {
+		if (strcmp(formals->children[i]->symbol, "&") == 0)
+			return 0;
+		evaluated = quoted = 0;
+		optimize_count(&body, formals->children[i]->symbol, &evaluated, &quoted);
+		if (evaluated != 1 || quoted != 0)
+			return 0;
+		if (call->children[i + 1]->type == SEXPRESSION_TYPE)
+			simple = 0;
+	}
+
+	if (!optimize_eager(&body, formals, call, 0))
+		return 0;
+	return simple || optimize_ordered(&body, formals, &next);
+}
+
+/*
+Checks that `formals` are evaluated in order and before any call in `code`
+finishes. `next` is index of the next expected formal.
+*/
+static unsigned char
+optimize_ordered(const Value *code, const Value *formals, size_t *next)
+{
+	size_t i;
+
+	if (code->type == SYMBOL_TYPE) {
+		for (i = 0; i < formals->children_count; ++i)
+			if (strcmp(formals->children[i]->symbol, code->symbol) == 0)
+				return i == (*next)++;
+	} else if (code->type == SEXPRESSION_TYPE) {
+		for (i = 0; i < code->children_count; ++i)
+			if (!optimize_ordered(code->children[i], formals, next))
+				return 0;
+		return *next == formals->children_count;
+	}
+	return 1;
+}
+
+/* Counts nodes of `code`. */
+static size_t
+optimize_size(const Value *code)
+{
+	size_t i,
+		rv = 1;
+
+	if (code->type == SEXPRESSION_TYPE || code->type == QEXPRESSION_TYPE)
+		for (i = 0; i < code->children_count; ++i)
+			rv += optimize_size(code->children[i]);
+	return rv;
+}
+
+/*
+Copies `code` replacing evaluated `formals` by copies of `call`'s arguments.
+Guards of optimized code are copied with substituted original code.
+*/
+static Value*
+optimize_substitute(const Value *code, const Value *formals, const Value *call)
+{
+	size_t i;
+	Value *rv;
+
+	if (code->type == SYMBOL_TYPE) {
+		for (i = 0; i < formals->children_count; ++i)
+			if (strcmp(formals->children[i]->symbol, code->symbol) == 0)
+				return value_copy(call->children[i + 1]);
+	} else if (code->type == SEXPRESSION_TYPE || code->type == QEXPRESSION_TYPE) {
+		rv = value_expression_alloc(code->type);
+		if (code->origin) {
+			rv->origin = optimize_substitute(code->origin, formals, call);
+			rv->guard = code->guard;
+			rv->guard_version = code->guard_version;
+		}
+		for (i = 0; i < code->children_count; ++i)
+			value_add_child(
+				rv,
+				code->type == SEXPRESSION_TYPE
+					? optimize_substitute(code->children[i], formals, call)
+					: value_copy(code->children[i])
+			);
+		return rv;
+	}
+	return value_copy(code);
+}
@@ -0,0 +1,13 @@
+#ifndef _OPTIMIZE_H
+#define _OPTIMIZE_H
+
+#include "env.h"
+#include "value.h"
+
+/* Command line flags */
+extern unsigned char optimize_enabled;
+extern unsigned char optimize_dump;
+
+Value *optimize(Value *, Env *);
+
+#endif /* _OPTIMIZE_H */
@@ -0,0 +1,124 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "number.h"
+#include "output.h"
+
+/*
+Buffered writer of standard output. Printed values are collected in a single
+buffer, which is written when it's full and at flush points: before prompts
+of REPL and `input` and at exit.
+*/
+
+static void output_write(const char *s, size_t length);
+
+/* Escaped characters and letters of their escape sequences */
+static const char output_escapes[] = "\a\b\f\n\r\t\v\\\'\"";
+static const char output_escape_letters[] = "abfnrtv\\\'\"";
+
+static char output_buffer[OUTPUT_BUFFER_SIZE];
+static size_t output_length = 0;
+
+void
+output_char(char c)
+{
+	if (output_length == OUTPUT_BUFFER_SIZE)
+		output_flush();
+	output_buffer[output_length++] = c;
+}
+
+/* Writes `s` with C escape sequences like `mpcf_escape`, but without copies. */
+void
+output_escaped(const char *s)
+{
+	const char *escape,
+		*start;
+
+	while (*s) {
+		/* Write the run of characters that need no escaping at once */
+		start = s;
+		while (*s && !strchr(output_escapes, *s))
+			++s;
+		output_write(start, s - start);
+
+		if (*s) {
+			escape = strchr(output_escapes, *s);
+			output_char('\\');
+			output_char(output_escape_letters[escape - output_escapes]);
+			++s;
+		}
+	}
+}
+
+void
+output_flush(void)
+{
+	fwrite(output_buffer, 1, output_length, stdout);
+	fflush(stdout);
+	output_length = 0;
+}
+
+/* Formats into the buffer. Output longer than the buffer is written as is. */
+void
+output_format(const char *fmt, ...)
+{
+	int length;
+	va_list va;
+
+	va_start(va, fmt);
+	length = vsnprintf(
+		output_buffer + output_length,
+		OUTPUT_BUFFER_SIZE - output_length,
+		fmt,
+		va
+	);
+	va_end(va);
+	if (length < 0 || (size_t)length < OUTPUT_BUFFER_SIZE - output_length) {
+		if (length > 0)
+			output_length += length;
+		return;
+	}
+
+	/* Retry in the empty buffer */
+	output_flush();
+	va_start(va, fmt);
+	if ((size_t)length < OUTPUT_BUFFER_SIZE)
+		output_length = vsnprintf(output_buffer, OUTPUT_BUFFER_SIZE, fmt, va);
+	else
+		vprintf(fmt, va);
+	va_end(va);
+}
+
+/* Formats number straight into the buffer. */
+void
+output_number(double x)
+{
+	if (OUTPUT_BUFFER_SIZE - output_length < NUMBER_BUFFER_SIZE)
+		output_flush();
+	output_length += number_format(x, output_buffer + output_length);
+}
+
+void
+output_string(const char *s)
+{
+	output_write(s, strlen(s));
+}
+
+static void
+output_write(const char *s, size_t length)
+{
+	size_t n;
+
+	while (length > 0) {
+		if (output_length == OUTPUT_BUFFER_SIZE)
+			output_flush();
+		n = OUTPUT_BUFFER_SIZE - output_length;
+		if (n > length)
+			n = length;
+		memcpy(output_buffer + output_length, s, n);
+		output_length += n;
+		s += n;
+		length -= n;
+	}
+}
@@ -0,0 +1,11 @@
+#ifndef _OUTPUT_H
+#define _OUTPUT_H
+
+void output_char(char);
+void output_escaped(const char *);
+void output_flush(void);
+void output_format(const char *, ...);
+void output_number(double);
+void output_string(const char *);
+
+#endif /* _OUTPUT_H */
@@ -0,0 +1,355 @@
+#include <string.h>
+#include "config.h"
+#include "pool.h"
+
+/*
+Allocator of small objects. Objects are carved from slabs and grouped by size
+classes of POOL_GRANULARITY bytes. Freed objects are kept in a free list of
+their class and reused, slabs are never returned to the system.
+
+Objects larger than POOL_MAX_SIZE are allocated by malloc. Define POOL_MALLOC
+to allocate everything by malloc, so sanitizers can track every object.
+
+While an arena is entered, small objects are bumped from the arena instead
+and freeing them does nothing. When the outermost arena is left, objects
+reachable from outside are promoted to the pool and the arena is reset at
+once. Promotion records new addresses of shared objects, so they are moved
+only once.
+*/
+#define POOL_CLASSES_COUNT (POOL_MAX_SIZE / POOL_GRANULARITY)
+
+/* Free object chained in a free list of its class */
+typedef struct PoolObject PoolObject;
+struct PoolObject {
+	PoolObject *next;
+};
+
+/* Slabs are chained to stay reachable. Objects follow the first granule */
+typedef struct PoolSlab PoolSlab;
+struct PoolSlab {
+	PoolSlab *next;
+};
+
+static size_t pool_forward_index(const void *ptr);
+#ifndef POOL_MALLOC
+static size_t pool_class(size_t size);
+static void pool_slab_alloc(size_t class_i);
+
+static PoolObject *pool_free_lists[POOL_CLASSES_COUNT];
+static PoolSlab *pool_slabs = NULL;
+#endif
+
+static char *pool_arena = NULL;
+static size_t pool_arena_depth = 0;
+static size_t pool_arena_live = 0;
+static size_t pool_arena_top = 0;
+
+/* Open addressing table of promoted addresses */
+static const void **pool_forwards_from = NULL;
+static void **pool_forwards_to = NULL;
+static size_t pool_forwards_count = 0;
+static size_t pool_forwards_size = 0;
+
+unsigned char pool_stats_enabled = 0;
+PoolStats pool_stats = {0, 0, 0};
+
+/* Allocates `size` bytes aligned for any object. */
+void*
+pool_alloc(size_t size)
+{
+#ifndef POOL_MALLOC
+	size_t class_i;
+	PoolObject *object;
+#endif
+
+	if (++pool_stats.live > pool_stats.peak)
+		pool_stats.peak = pool_stats.live;
+
+#ifdef POOL_MALLOC
+	return malloc(size);
+#else
+	if (size > POOL_MAX_SIZE)
+		return malloc(size);
+
+	/* Bump object from arena until it's full */
+	class_i = pool_class(size);
+	if (
+		pool_arena_depth > 0
+		&& pool_arena_top + (class_i + 1) * POOL_GRANULARITY <= POOL_ARENA_SIZE
+	) {
+		object = (PoolObject *)(pool_arena + pool_arena_top);
+		pool_arena_top += (class_i + 1) * POOL_GRANULARITY;
+		++pool_arena_live;
+		return object;
+	}
+
+	/* Pop object from free list of its class */
+	if (!pool_free_lists[class_i])
+		pool_slab_alloc(class_i);
+	object = pool_free_lists[class_i];
+	pool_free_lists[class_i] = object->next;
+	return object;
+#endif
+}
+
+/* Allocates `size` bytes outside arena even if it's entered. */
+void*
+pool_alloc_outside(size_t size)
+{
+	size_t depth = pool_arena_depth;
+	void *rv;
+
+	pool_arena_depth = 0;
+	rv = pool_alloc(size);
+	pool_arena_depth = depth;
+	return rv;
+}
+
+/* Frees `ptr` allocated by `pool_alloc` with the same `size`. */
+void
+pool_free(void *ptr, size_t size)
+{
+#ifndef POOL_MALLOC
+	PoolObject *object;
+	size_t class_i;
+#endif
+
+	--pool_stats.live;
+
+#ifdef POOL_MALLOC
+	(void)size;
+	free(ptr);
+#else
+	if (size > POOL_MAX_SIZE) {
+		free(ptr);
+		return;
+	}
+
+	/* Arena objects are released by reset */
+	if (pool_arena_contains(ptr)) {
+		--pool_arena_live;
+		return;
+	}
+
+	/* Push object to free list of its class */
+	object = ptr;
+	class_i = pool_class(size);
+	object->next = pool_free_lists[class_i];
+	pool_free_lists[class_i] = object;
+#endif
+}
+
+/* Enters arena. Arenas are nested, only the outermost one is reset. */
+void
+pool_arena_begin(void)
+{
+#ifndef POOL_MALLOC
+	if (!pool_arena)
+		pool_arena = malloc(POOL_ARENA_SIZE);
+#endif
+	++pool_arena_depth;
+}
+
+/* Whether `ptr` is allocated in arena. */
+unsigned char
+pool_arena_contains(const void *ptr)
+{
+	return pool_arena
+		&& (const char *)ptr >= pool_arena
+		&& (const char *)ptr < pool_arena + POOL_ARENA_SIZE;
+}
+
+/*
+Leaves arena. Returns 1 if the outermost arena is left, then escaped objects
+should be promoted before `pool_arena_reset`.
+*/
+unsigned char
+pool_arena_end(void)
+{
+	return --pool_arena_depth == 0;
+}
+
+/* Releases all arena objects and forgets promoted addresses. */
+void
+pool_arena_reset(void)
+{
+	size_t i;
+
+	pool_stats.live -= pool_arena_live;
+	pool_arena_live = 0;
+	pool_arena_top = 0;
+
+	if (pool_forwards_count == 0)
+		return;
+
+	/* Table grown by a large promotion isn't cleared after each form */
+	if (pool_forwards_size > POOL_FORWARDS_MIN_SIZE) {
+		free(pool_forwards_from);
+		free(pool_forwards_to);
+		pool_forwards_from = NULL;
+		pool_forwards_to = NULL;
+		pool_forwards_size = 0;
+	} else {
+		for (i = 0; i < pool_forwards_size; ++i)
+			pool_forwards_from[i] = NULL;
+	}
+	pool_forwards_count = 0;
+}
+
+/* Returns address `ptr` was promoted to or NULL if it wasn't visited. */
+void*
+pool_forward(const void *ptr)
+{
+	size_t i;
+
+	if (pool_forwards_count == 0)
+		return NULL;
+	i = pool_forward_index(ptr);
+	return pool_forwards_from[i] ? pool_forwards_to[i] : NULL;
+}
+
+/* Records that `ptr` is promoted to `to`. */
+void
+pool_forward_set(const void *ptr, void *to)
+{
+	size_t i,
+		size = pool_forwards_size;
+	const void **from = pool_forwards_from;
+	void **tos = pool_forwards_to;
+
+	/* Keep load factor under a half */
+	if (2 * (pool_forwards_count + 1) > pool_forwards_size) {
+		pool_forwards_size = size ? size * 2 : POOL_FORWARDS_MIN_SIZE;
+		pool_forwards_from = calloc(pool_forwards_size, sizeof(void *));
+		pool_forwards_to = calloc(pool_forwards_size, sizeof(void *));
+		for (i = 0; i < size; ++i) {
+			if (from[i]) {
+				pool_forwards_from[pool_forward_index(from[i])] = from[i];
+				pool_forwards_to[pool_forward_index(from[i])] = tos[i];
+			}
+		}
+		free(from);
+		free(tos);
+	}
+
+	i = pool_forward_index(ptr);
+	if (!pool_forwards_from[i])
+		++pool_forwards_count;
+	pool_forwards_from[i] = ptr;
+	pool_forwards_to[i] = to;
+}
+
+/*
+Copies `ptr` of `size` bytes out of arena. Objects outside are kept. Copy is
+allocated outside even if arena is still entered.
+*/
+void*
+pool_promote(void *ptr, size_t size)
+{
+	void *rv;
+
+	if (!pool_arena_contains(ptr))
+		return ptr;
+	rv = pool_alloc_outside(size);
+	memcpy(rv, ptr, size);
+	return rv;
+}
+
+/* Appends `t` to pooled string `s`, which is freed. */
+char*
+pool_strcat(char *s, const char *t)
+{
+	size_t s_length = strlen(s),
+		size = sizeof(size_t) + s_length + strlen(t) + 1,
+		*header = pool_alloc(size);
+	char *rv = (char *)(header + 1);
+
+	*header = size;
+	memcpy(rv, s, s_length);
+	strcpy(rv + s_length, t);
+	pool_strfree(s);
+	return rv;
+}
+
+/*
+Copies `s` to pooled memory. Size of allocation is kept before the string,
+because string may be cut in place.
+*/
+char*
+pool_strdup(const char *s)
+{
+	size_t size = sizeof(size_t) + strlen(s) + 1,
+		*header = pool_alloc(size);
+
+	*header = size;
+	strcpy((char *)(header + 1), s);
+	return (char *)(header + 1);
+}
+
+/* Copies pooled string `s` out of arena. Strings outside are kept. */
+char*
+pool_strpromote(char *s)
+{
+	size_t *header = (size_t *)s - 1;
+	return (char *)((size_t *)pool_promote(header, *header) + 1);
+}
+
+/* Frees string allocated by `pool_strdup` or `pool_strcat`. */
+void
+pool_strfree(char *s)
+{
+	size_t *header = (size_t *)s - 1;
+	pool_free(header, *header);
+}
+
+/*
+Slot of `ptr` or of the empty place for it in the forwards table. Address is
+mixed, because objects allocated in a row would fill a run of slots, which
+linear probing walks on each insertion.
+*/
+static size_t
+pool_forward_index(const void *ptr)
+{
+	size_t i = (size_t)ptr >> 4;
+
+	i ^= i >> 16;
+	i *= 0x45d9f3bu;
+	i ^= i >> 16;
+	i &= pool_forwards_size - 1;
+
+	while (pool_forwards_from[i] && pool_forwards_from[i] != ptr)
+		i = (i + 1) & (pool_forwards_size - 1);
+	return i;
+}
+
+#ifndef POOL_MALLOC
+static size_t
+pool_class(size_t size)
+{
+	return size == 0 ? 0 : (size - 1) / POOL_GRANULARITY;
+}
+
+/* Carves new slab to objects of class `class_i`. */
+static void
+pool_slab_alloc(size_t class_i)
+{
+	size_t object_size = (class_i + 1) * POOL_GRANULARITY,
+		offset;
+	PoolObject *object;
+	PoolSlab *slab = malloc(POOL_SLAB_SIZE);
+
+	slab->next = pool_slabs;
+	pool_slabs = slab;
+	++pool_stats.slabs;
+
+	for (
+		offset = POOL_GRANULARITY;
+		offset + object_size <= POOL_SLAB_SIZE;
+		offset += object_size
+	) {
+		object = (PoolObject *)((char *)slab + offset);
+		object->next = pool_free_lists[class_i];
+		pool_free_lists[class_i] = object;
+	}
+}
+#endif
@@ -0,0 +1,33 @@
+#ifndef _POOL_H
+#define _POOL_H
+
+#include <stdlib.h>
+
+/* Counters of pooled objects */
+typedef struct PoolStats {
+	size_t live;
+	size_t peak;
+	size_t slabs;
+} PoolStats;
+
+/* Command line flag */
+extern unsigned char pool_stats_enabled;
+
+extern PoolStats pool_stats;
+
+void *pool_alloc(size_t);
+void *pool_alloc_outside(size_t);
+void pool_arena_begin(void);
+unsigned char pool_arena_contains(const void *);
+unsigned char pool_arena_end(void);
+void pool_arena_reset(void);
+void *pool_forward(const void *);
+void pool_forward_set(const void *, void *);
+void pool_free(void *, size_t);
+void *pool_promote(void *, size_t);
+char *pool_strcat(char *, const char *);
+char *pool_strdup(const char *);
+void pool_strfree(char *);
+char *pool_strpromote(char *);
+
+#endif /* _POOL_H */
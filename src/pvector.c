@@ -0,0 +1,743 @@
+#include <stdlib.h>
+#include <string.h>
+#include "pool.h"
+#include "pvector.h"
+
+static Pvector *pvector_conj_item(Pvector *pvector, PvectorItem *item);
+static Pvector *pvector_edit(Pvector *pvector);
+static PvectorItem *pvector_item_alloc(Value *value);
+static PvectorItem *pvector_item_promote(PvectorItem *item);
+static void pvector_item_release(PvectorItem *item);
+static PvectorNode *pvector_node_alloc(unsigned char leaf);
+static PvectorNode *pvector_node_assoc(
+	PvectorNode *node,
+	unsigned shift,
+	size_t index,
+	Value *value
+);
+static PvectorNode *pvector_node_concat(
+	PvectorNode *left,
+	unsigned left_shift,
+	PvectorNode *right,
+	unsigned right_shift
+);
+static PvectorNode *pvector_node_edit(PvectorNode *node);
+static PvectorNode *pvector_node_path(unsigned shift, PvectorNode *leaf);
+static size_t pvector_node_plan(size_t *counts, size_t count);
+static void pvector_node_promote(PvectorNode *node);
+static PvectorNode *pvector_node_push(
+	PvectorNode *node,
+	unsigned shift,
+	PvectorNode *leaf
+);
+static PvectorNode *pvector_node_rebalance(
+	const PvectorNode *left,
+	const PvectorNode *center,
+	const PvectorNode *right,
+	unsigned shift
+);
+static void pvector_node_release(PvectorNode *node);
+static unsigned char pvector_node_room(const PvectorNode *node, unsigned shift);
+static size_t pvector_node_size(const PvectorNode *node, unsigned shift);
+static void pvector_node_sizes(PvectorNode *node, unsigned shift);
+static size_t pvector_node_slot(
+	const PvectorNode *node,
+	unsigned shift,
+	size_t *index
+);
+static size_t pvector_tail_offset(const Pvector *pvector);
+static void pvector_tail_push(Pvector *pvector);
+
+/* Allocates empty vector. */
+Pvector*
+pvector_alloc(void)
+{
+	Pvector *rv = malloc(sizeof(Pvector));
+	rv->refs = 1;
+	rv->count = 0;
+	rv->shift = PVECTOR_BITS;
+	rv->root = pvector_node_alloc(0);
+	rv->tail = pvector_node_alloc(1);
+	return rv;
+}
+
+/*
+Returns version of `pvector` with item at valid `index` replaced by `value`.
+Takes ownership of reference to `pvector` and of `value`.
+*/
+Pvector*
+pvector_assoc(Pvector *pvector, size_t index, Value *value)
+{
+	size_t tail_offset = pvector_tail_offset(pvector);
+
+	pvector = pvector_edit(pvector);
+	if (index >= tail_offset) {
+		pvector->tail = pvector_node_edit(pvector->tail);
+		pvector_item_release(pvector->tail->slots.items[index - tail_offset]);
+		pvector->tail->slots.items[index - tail_offset] = pvector_item_alloc(
+			value
+		);
+	} else {
+		pvector->root = pvector_node_assoc(
+			pvector->root,
+			pvector->shift,
+			index,
+			value
+		);
+	}
+	return pvector;
+}
+
+/*
+Returns version of `pvector` with items of `other` appended. Tries are joined
+by merging nodes along the edges where they meet, so it takes O(log n) steps
+and the rest of both tries is shared. Takes ownership of reference to
+`pvector`.
+*/
+Pvector*
+pvector_concat(Pvector *pvector, Pvector *other)
+{
+	size_t i;
+	unsigned shift;
+	PvectorNode *root;
+
+	if (other->count == 0)
+		return pvector;
+	if (pvector->count == 0) {
+		pvector_free(pvector);
+		return pvector_copy(other);
+	}
+
+	/* Items of vector without trie are appended to the tail */
+	if (other->count == other->tail->count) {
+		for (i = 0; i < other->tail->count; ++i) {
+			++other->tail->slots.items[i]->refs;
+			pvector = pvector_conj_item(pvector, other->tail->slots.items[i]);
+		}
+		return pvector;
+	}
+
+	/* Join trie with the tail to the other's trie, the other's tail is shared */
+	pvector = pvector_edit(pvector);
+	pvector_tail_push(pvector);
+	root = pvector_node_concat(
+		pvector->root,
+		pvector->shift,
+		other->root,
+		other->shift
+	);
+	shift = pvector->shift > other->shift ? pvector->shift : other->shift;
+	pvector_node_release(pvector->root);
+	if (root->count == 1) {
+		pvector->root = root->slots.children[0];
+		++pvector->root->refs;
+		pvector_node_release(root);
+		pvector->shift = shift;
+	} else {
+		pvector->root = root;
+		pvector->shift = shift + PVECTOR_BITS;
+	}
+	pvector->tail = other->tail;
+	++pvector->tail->refs;
+	pvector->count += other->count;
+	return pvector;
+}
+
+/*
+Returns version of `pvector` with `value` appended. Takes ownership of
+reference to `pvector` and of `value`.
+*/
+Pvector*
+pvector_conj(Pvector *pvector, Value *value)
+{
+	return pvector_conj_item(pvector, pvector_item_alloc(value));
+}
+
+/* Shares vector with new owner. */
+Pvector*
+pvector_copy(Pvector *pvector)
+{
+	++pvector->refs;
+	return pvector;
+}
+
+void
+pvector_free(Pvector *pvector)
+{
+	if (--pvector->refs > 0)
+		return;
+
+	pvector_node_release(pvector->root);
+	pvector_node_release(pvector->tail);
+	free(pvector);
+}
+
+/* Returns item at valid `index`. */
+const Value*
+pvector_nth(const Pvector *pvector, size_t index)
+{
+	unsigned shift;
+	size_t tail_offset = pvector_tail_offset(pvector);
+	const PvectorNode *node;
+
+	if (index >= tail_offset)
+		return pvector->tail->slots.items[index - tail_offset]->value;
+
+	node = pvector->root;
+	for (shift = pvector->shift; shift > 0; shift -= PVECTOR_BITS)
+		node = node->slots.children[pvector_node_slot(node, shift, &index)];
+	return node->slots.items[index]->value;
+}
+
+/* Moves items out of arena once. */
+void
+pvector_promote(Pvector *pvector)
+{
+	if (pool_forward(pvector))
+		return;
+	pool_forward_set(pvector, pvector);
+
+	pvector_node_promote(pvector->root);
+	pvector_node_promote(pvector->tail);
+}
+
+/*
+Returns version of `pvector` with shared `item` appended. Takes ownership of
+reference to `pvector` and of `item`.
+*/
+static Pvector*
+pvector_conj_item(Pvector *pvector, PvectorItem *item)
+{
+	pvector = pvector_edit(pvector);
+	if (pvector->tail->count == PVECTOR_WIDTH) {
+		pvector_tail_push(pvector);
+		pvector->tail = pvector_node_alloc(1);
+	} else {
+		pvector->tail = pvector_node_edit(pvector->tail);
+	}
+	pvector->tail->slots.items[pvector->tail->count++] = item;
+	++pvector->count;
+	return pvector;
+}
+
+/*
+Returns `pvector` if caller holds the only reference to it or a new version
+sharing its nodes. Takes ownership of the reference.
+*/
+static Pvector*
+pvector_edit(Pvector *pvector)
+{
+	Pvector *rv;
+
+	if (pvector->refs == 1)
+		return pvector;
+
+	rv = malloc(sizeof(Pvector));
+	rv->refs = 1;
+	rv->count = pvector->count;
+	rv->shift = pvector->shift;
+	rv->root = pvector->root;
+	rv->tail = pvector->tail;
+	++rv->root->refs;
+	++rv->tail->refs;
+	--pvector->refs;
+	return rv;
+}
+
+/* Allocates item taking ownership of `value`. */
+static PvectorItem*
+pvector_item_alloc(Value *value)
+{
+	PvectorItem *rv = pool_alloc(sizeof(PvectorItem));
+	rv->refs = 1;
+	rv->value = value;
+	return rv;
+}
+
+/* Moves shared `item` and its value out of arena once. */
+static PvectorItem*
+pvector_item_promote(PvectorItem *item)
+{
+	PvectorItem *rv = pool_forward(item);
+
+	if (!rv) {
+		rv = pool_promote(item, sizeof(PvectorItem));
+		pool_forward_set(item, rv);
+		rv->value = value_promote(rv->value);
+	}
+	return rv;
+}
+
+static void
+pvector_item_release(PvectorItem *item)
+{
+	if (--item->refs > 0)
+		return;
+	value_free(item->value);
+	pool_free(item, sizeof(PvectorItem));
+}
+
+static PvectorNode*
+pvector_node_alloc(unsigned char leaf)
+{
+	PvectorNode *rv = malloc(sizeof(PvectorNode));
+	rv->refs = 1;
+	rv->leaf = leaf;
+	rv->promoted = 0;
+	rv->count = 0;
+	rv->sizes = NULL;
+	return rv;
+}
+
+/* Replaces item at `index` under `node` of level `shift` by path copying. */
+static PvectorNode*
+pvector_node_assoc(
+	PvectorNode *node,
+	unsigned shift,
+	size_t index,
+	Value *value
+)
+{
+	size_t i;
+
+	node = pvector_node_edit(node);
+	if (shift == 0) {
+		pvector_item_release(node->slots.items[index]);
+		node->slots.items[index] = pvector_item_alloc(value);
+	} else {
+		i = pvector_node_slot(node, shift, &index);
+		node->slots.children[i] = pvector_node_assoc(
+			node->slots.children[i],
+			shift - PVECTOR_BITS,
+			index,
+			value
+		);
+	}
+	return node;
+}
+
+/*
+Joins trie under `left` of level `left_shift` with trie under `right` of level
+`right_shift`. Only nodes along the right edge of `left` and the left edge of
+`right` are merged, the others are shared. Returns branch of the level above
+the higher one with one or two children.
+*/
+static PvectorNode*
+pvector_node_concat(
+	PvectorNode *left,
+	unsigned left_shift,
+	PvectorNode *right,
+	unsigned right_shift
+)
+{
+	PvectorNode *center,
+		*rv;
+
+	if (left_shift > right_shift) {
+		center = pvector_node_concat(
+			left->slots.children[left->count - 1],
+			left_shift - PVECTOR_BITS,
+			right,
+			right_shift
+		);
+		rv = pvector_node_rebalance(left, center, NULL, left_shift);
+	} else if (left_shift < right_shift) {
+		center = pvector_node_concat(
+			left,
+			left_shift,
+			right->slots.children[0],
+			right_shift - PVECTOR_BITS
+		);
+		rv = pvector_node_rebalance(NULL, center, right, right_shift);
+	} else if (left_shift == 0) {
+		/* Leaves are merged by the caller */
+		rv = pvector_node_alloc(0);
+		rv->slots.children[0] = left;
+		rv->slots.children[1] = right;
+		rv->count = 2;
+		++left->refs;
+		++right->refs;
+		return rv;
+	} else {
+		center = pvector_node_concat(
+			left->slots.children[left->count - 1],
+			left_shift - PVECTOR_BITS,
+			right->slots.children[0],
+			right_shift - PVECTOR_BITS
+		);
+		rv = pvector_node_rebalance(left, center, right, left_shift);
+	}
+	pvector_node_release(center);
+	return rv;
+}
+
+/*
+Returns `node` if it is referenced only by the caller, who already owns the
+path to it, or its copy otherwise. Takes ownership of the reference.
+
+Nodes reached through a copied parent have at least two references, so
+editing copies the whole path from the first shared node down.
+*/
+static PvectorNode*
+pvector_node_edit(PvectorNode *node)
+{
+	size_t i;
+	PvectorNode *rv;
+
+	/* Node changed in place may get items from arena */
+	if (node->refs == 1) {
+		node->promoted = 0;
+		return node;
+	}
+
+	rv = pvector_node_alloc(node->leaf);
+	rv->count = node->count;
+	for (i = 0; i < node->count; ++i) {
+		if (node->leaf) {
+			rv->slots.items[i] = node->slots.items[i];
+			++rv->slots.items[i]->refs;
+		} else {
+			rv->slots.children[i] = node->slots.children[i];
+			++rv->slots.children[i]->refs;
+		}
+	}
+	if (node->sizes) {
+		rv->sizes = malloc(sizeof(size_t) * PVECTOR_WIDTH);
+		memcpy(rv->sizes, node->sizes, sizeof(size_t) * node->count);
+	}
+	--node->refs;
+	return rv;
+}
+
+/* Wraps `leaf` in branches down from level `shift`. */
+static PvectorNode*
+pvector_node_path(unsigned shift, PvectorNode *leaf)
+{
+	PvectorNode *rv;
+
+	if (shift == 0)
+		return leaf;
+
+	rv = pvector_node_alloc(0);
+	rv->slots.children[0] = pvector_node_path(shift - PVECTOR_BITS, leaf);
+	rv->count = 1;
+	return rv;
+}
+
+/*
+Plans slots of `count` merged nodes with `counts` slots, so that there are at
+most `PVECTOR_EXTRAS` nodes more than the fewest which could hold the slots.
+Slots of the first node which isn't full are spread over the next nodes until
+one of them is left empty. Returns the new count of nodes.
+*/
+static size_t
+pvector_node_plan(size_t *counts, size_t count)
+{
+	size_t i,
+		j,
+		fewest,
+		filled,
+		left,
+		total = 0;
+
+	for (i = 0; i < count; ++i)
+		total += counts[i];
+	fewest = (total + PVECTOR_WIDTH - 1) / PVECTOR_WIDTH;
+
+	i = 0;
+	while (count > fewest + PVECTOR_EXTRAS) {
+		while (counts[i] == PVECTOR_WIDTH)
+			++i;
+
+		left = counts[i];
+		do {
+			filled = left + counts[i + 1] < PVECTOR_WIDTH
+				? left + counts[i + 1]
+				: PVECTOR_WIDTH;
+			left = left + counts[i + 1] - filled;
+			counts[i++] = filled;
+		} while (left > 0);
+
+		for (j = i; j + 1 < count; ++j)
+			counts[j] = counts[j + 1];
+		--count;
+		--i;
+	}
+	return count;
+}
+
+/*
+Moves items under shared `node` out of arena once. Nodes promoted by previous
+forms are skipped, so a new version promotes only its new path.
+*/
+static void
+pvector_node_promote(PvectorNode *node)
+{
+	size_t i;
+
+	if (node->promoted)
+		return;
+	node->promoted = 1;
+
+	for (i = 0; i < node->count; ++i) {
+		if (node->leaf)
+			node->slots.items[i] = pvector_item_promote(node->slots.items[i]);
+		else
+			pvector_node_promote(node->slots.children[i]);
+	}
+}
+
+/*
+Appends `leaf` on the right edge of trie under `node` of level `shift`, which
+has room for it. Branch is relaxed if the leaf follows a child which isn't
+full.
+*/
+static PvectorNode*
+pvector_node_push(PvectorNode *node, unsigned shift, PvectorNode *leaf)
+{
+	size_t last;
+
+	node = pvector_node_edit(node);
+	last = node->count - 1;
+	if (
+		shift > PVECTOR_BITS
+		&& node->count > 0
+		&& pvector_node_room(node->slots.children[last], shift - PVECTOR_BITS)
+	) {
+		node->slots.children[last] = pvector_node_push(
+			node->slots.children[last],
+			shift - PVECTOR_BITS,
+			leaf
+		);
+		if (node->sizes)
+			node->sizes[last] += leaf->count;
+		return node;
+	}
+
+	node->slots.children[node->count++] = pvector_node_path(
+		shift - PVECTOR_BITS,
+		leaf
+	);
+	if (node->sizes)
+		node->sizes[node->count - 1] = node->sizes[last] + leaf->count;
+	else if (
+		node->count > 1
+		&& pvector_node_size(node->slots.children[last], shift - PVECTOR_BITS)
+			!= (size_t)1 << shift
+	)
+		pvector_node_sizes(node, shift);
+	return node;
+}
+
+/*
+Merges children of `left` but the last, children of `center` and children of
+`right` but the first, all of level `shift` - `PVECTOR_BITS`. Their slots are
+moved by plan of `pvector_node_plan`, which bounds the slots skipped by lookup
+in relaxed branch. Children keeping their slots are shared. Returns branch of
+level `shift` + `PVECTOR_BITS` with one or two branches of level `shift`.
+*/
+static PvectorNode*
+pvector_node_rebalance(
+	const PvectorNode *left,
+	const PvectorNode *center,
+	const PvectorNode *right,
+	unsigned shift
+)
+{
+	size_t i,
+		j = 0,
+		slot = 0,
+		count = 0,
+		counts[2 * PVECTOR_WIDTH];
+	PvectorNode *children[2 * PVECTOR_WIDTH],
+		*node,
+		*rv;
+
+	for (i = 0; left && i + 1 < left->count; ++i)
+		children[count++] = left->slots.children[i];
+	for (i = 0; i < center->count; ++i)
+		children[count++] = center->slots.children[i];
+	for (i = 1; right && i < right->count; ++i)
+		children[count++] = right->slots.children[i];
+
+	for (i = 0; i < count; ++i)
+		counts[i] = children[i]->count;
+	count = pvector_node_plan(counts, count);
+
+	/* Refill children by the plan in place of the old ones they are built of */
+	for (i = 0; i < count; ++i) {
+		if (slot == 0 && children[j]->count == counts[i]) {
+			node = children[j++];
+			++node->refs;
+		} else {
+			node = pvector_node_alloc(children[j]->leaf);
+			for (; node->count < counts[i]; ++node->count) {
+				if (node->leaf) {
+					node->slots.items[node->count] = children[j]->slots.items[slot];
+					++node->slots.items[node->count]->refs;
+				} else {
+					node->slots.children[node->count] =
+						children[j]->slots.children[slot];
+					++node->slots.children[node->count]->refs;
+				}
+				if (++slot == children[j]->count) {
+					slot = 0;
+					++j;
+				}
+			}
+			if (!node->leaf)
+				pvector_node_sizes(node, shift - PVECTOR_BITS);
+		}
+		children[i] = node;
+	}
+
+	/* Split children to branches of `PVECTOR_WIDTH` */
+	rv = pvector_node_alloc(0);
+	for (i = 0; i < count; i += PVECTOR_WIDTH) {
+		node = pvector_node_alloc(0);
+		node->count = count - i < PVECTOR_WIDTH ? count - i : PVECTOR_WIDTH;
+		memcpy(
+			node->slots.children,
+			children + i,
+			sizeof(PvectorNode *) * node->count
+		);
+		pvector_node_sizes(node, shift);
+		rv->slots.children[rv->count++] = node;
+	}
+	pvector_node_sizes(rv, shift + PVECTOR_BITS);
+	return rv;
+}
+
+static void
+pvector_node_release(PvectorNode *node)
+{
+	size_t i;
+
+	if (--node->refs > 0)
+		return;
+
+	for (i = 0; i < node->count; ++i) {
+		if (node->leaf)
+			pvector_item_release(node->slots.items[i]);
+		else
+			pvector_node_release(node->slots.children[i]);
+	}
+	free(node->sizes);
+	free(node);
+}
+
+/* Tells whether a leaf can be pushed on the right edge of trie under `node`. */
+static unsigned char
+pvector_node_room(const PvectorNode *node, unsigned shift)
+{
+	return node->count < PVECTOR_WIDTH
+		|| (
+			shift > PVECTOR_BITS
+			&& pvector_node_room(
+				node->slots.children[node->count - 1],
+				shift - PVECTOR_BITS
+			)
+		);
+}
+
+/* Count of items under `node` of level `shift`. */
+static size_t
+pvector_node_size(const PvectorNode *node, unsigned shift)
+{
+	if (node->leaf || node->count == 0)
+		return node->count;
+	if (node->sizes)
+		return node->sizes[node->count - 1];
+	return ((node->count - 1) << shift) + pvector_node_size(
+		node->slots.children[node->count - 1],
+		shift - PVECTOR_BITS
+	);
+}
+
+/*
+Fills table of sizes of branch `node` of level `shift` if a child but the last
+isn't full, otherwise drops it.
+*/
+static void
+pvector_node_sizes(PvectorNode *node, unsigned shift)
+{
+	size_t i,
+		sizes[PVECTOR_WIDTH];
+	unsigned char regular = 1;
+
+	for (i = 0; i < node->count; ++i) {
+		sizes[i] = pvector_node_size(
+			node->slots.children[i],
+			shift - PVECTOR_BITS
+		);
+		if (i + 1 < node->count && sizes[i] != (size_t)1 << shift)
+			regular = 0;
+		if (i > 0)
+			sizes[i] += sizes[i - 1];
+	}
+
+	if (regular) {
+		free(node->sizes);
+		node->sizes = NULL;
+		return;
+	}
+	if (!node->sizes)
+		node->sizes = malloc(sizeof(size_t) * PVECTOR_WIDTH);
+	memcpy(node->sizes, sizes, sizeof(size_t) * node->count);
+}
+
+/*
+Returns slot of child of branch `node` of level `shift` with item at `index`
+and makes `index` relative to the child.
+*/
+static size_t
+pvector_node_slot(const PvectorNode *node, unsigned shift, size_t *index)
+{
+	size_t i = *index >> shift;
+
+	if (!node->sizes) {
+		*index -= i << shift;
+		return i;
+	}
+
+	/* Children hold at most `1 << shift` items, so the slot isn't before `i` */
+	while (node->sizes[i] <= *index)
+		++i;
+	if (i > 0)
+		*index -= node->sizes[i - 1];
+	return i;
+}
+
+/* Returns index of the first item in tail. */
+static size_t
+pvector_tail_offset(const Pvector *pvector)
+{
+	return pvector->count - pvector->tail->count;
+}
+
+/*
+Moves tail of edited `pvector` to its trie, adding a level above the root if
+the right edge is full. Tail is left for the caller to set.
+*/
+static void
+pvector_tail_push(Pvector *pvector)
+{
+	PvectorNode *root;
+
+	if (pvector_node_room(pvector->root, pvector->shift)) {
+		pvector->root = pvector_node_push(
+			pvector->root,
+			pvector->shift,
+			pvector->tail
+		);
+		return;
+	}
+
+	root = pvector_node_alloc(0);
+	root->slots.children[0] = pvector->root;
+	root->slots.children[1] = pvector_node_path(pvector->shift, pvector->tail);
+	root->count = 2;
+	pvector->shift += PVECTOR_BITS;
+	pvector_node_sizes(root, pvector->shift);
+	pvector->root = root;
+}
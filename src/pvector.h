@@ -0,0 +1,72 @@
+#ifndef _PVECTOR_H
+#define _PVECTOR_H
+
+#include <stdlib.h>
+#include "config.h"
+#include "value.h"
+
+#define PVECTOR_WIDTH (1 << PVECTOR_BITS)
+#define PVECTOR_MASK (PVECTOR_WIDTH - 1)
+
+/*
+Item shared between leaves of versions of vectors, so a copied leaf doesn't
+copy its values
+*/
+typedef struct PvectorItem {
+	size_t refs;
+	Value *value;
+} PvectorItem;
+
+/*
+Node of persistent vector trie. Leaves hold items, branches hold children.
+Nodes are immutable once shared and are shared between versions of vectors.
+
+Branch is regular if all its children but the last are full, so a child is
+found by bits of index. Concatenation leaves relaxed branches with children
+which aren't full, they find a child by a table of sizes
+*/
+typedef struct PvectorNode PvectorNode;
+struct PvectorNode {
+	size_t refs;
+	unsigned char leaf;
+
+	/* Set once items under the node are moved out of arena */
+	unsigned char promoted;
+
+	/* Count of filled slots. Slots are filled from the start */
+	size_t count;
+
+	/*
+	Counts of items under children of relaxed branch up to and including
+	each one. NULL for leaf and regular branch
+	*/
+	size_t *sizes;
+	union {
+		PvectorNode *children[PVECTOR_WIDTH];
+		PvectorItem *items[PVECTOR_WIDTH];
+	} slots;
+};
+
+/*
+Immutable vector: trie of leaves of up to `PVECTOR_WIDTH` items and a tail
+leaf with the last items, which isn't empty unless the vector is. Shared
+between copies of persistent vector value.
+*/
+typedef struct Pvector {
+	size_t refs;
+	size_t count;
+	unsigned shift;
+	PvectorNode *root;
+	PvectorNode *tail;
+} Pvector;
+
+Pvector *pvector_alloc(void);
+Pvector *pvector_assoc(Pvector *, size_t, Value *);
+Pvector *pvector_concat(Pvector *, Pvector *);
+Pvector *pvector_conj(Pvector *, Value *);
+Pvector *pvector_copy(Pvector *);
+void pvector_free(Pvector *);
+const Value *pvector_nth(const Pvector *, size_t);
+void pvector_promote(Pvector *);
+
+#endif /* _PVECTOR_H */
@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <string.h>
+#include "pool.h"
+#include "record.h"
+#include "utils.h"
+
+static size_t record_size(const RecordType *type);
+
+/*
+Allocates record of `type` with fields moved from `fields`. Record is a single
+pooled object, so fields are read at fixed offsets.
+*/
+Record*
+record_alloc(RecordType *type, Value **fields)
+{
+	Record *rv = pool_alloc(record_size(type));
+	rv->refs = 1;
+	rv->type = type;
+	++type->refs;
+	memcpy(rv->fields, fields, sizeof(Value *) * type->fields_count);
+	return rv;
+}
+
+/* Shares record with new owner. */
+Record*
+record_copy(Record *record)
+{
+	++record->refs;
+	return record;
+}
+
+void
+record_free(Record *record)
+{
+	size_t i;
+	RecordType *type = record->type;
+
+	if (--record->refs > 0)
+		return;
+
+	for (i = 0; i < type->fields_count; ++i)
+		value_free(record->fields[i]);
+	pool_free(record, record_size(type));
+	record_type_free(type);
+}
+
+/*
+Allocates function of `type` of `kind`, which is named after the type. Name
+of accessor of `field` is suffixed by the field.
+*/
+RecordFunction*
+record_function_alloc(RecordType *type, RecordFunctionKind kind, size_t field)
+{
+	size_t length = strlen(type->name) + 2;
+	RecordFunction *rv = malloc(sizeof(RecordFunction));
+
+	rv->refs = 1;
+	rv->type = type;
+	++type->refs;
+	rv->kind = kind;
+	rv->field = field;
+
+	if (kind == RECORD_ACCESSOR)
+		length += strlen(type->fields[field]);
+	rv->name = malloc(length);
+	if (kind == RECORD_CONSTRUCTOR)
+		strcpy(rv->name, type->name);
+	else if (kind == RECORD_PREDICATE)
+		sprintf(rv->name, "%s?", type->name);
+	else
+		sprintf(rv->name, "%s-%s", type->name, type->fields[field]);
+	return rv;
+}
+
+/* Shares function with new owner. */
+RecordFunction*
+record_function_copy(RecordFunction *function)
+{
+	++function->refs;
+	return function;
+}
+
+void
+record_function_free(RecordFunction *function)
+{
+	if (--function->refs > 0)
+		return;
+
+	record_type_free(function->type);
+	free(function->name);
+	free(function);
+}
+
+/* Moves record and its fields out of arena once. Returns its new address. */
+Record*
+record_promote(Record *record)
+{
+	size_t i;
+	Record *rv = pool_forward(record);
+
+	if (!rv) {
+		rv = pool_promote(record, record_size(record->type));
+		pool_forward_set(record, rv);
+		for (i = 0; i < rv->type->fields_count; ++i)
+			rv->fields[i] = value_promote(rv->fields[i]);
+	}
+	return rv;
+}
+
+/* Allocates type named `name` with fields named by symbols of `fields`. */
+RecordType*
+record_type_alloc(const char *name, const Value *fields)
+{
+	size_t i;
+	RecordType *rv = malloc(sizeof(RecordType));
+
+	rv->refs = 1;
+	rv->name = strdup(name);
+	rv->fields_count = fields->children_count;
+	rv->fields = malloc(sizeof(char *) * rv->fields_count);
+	for (i = 0; i < rv->fields_count; ++i)
+		rv->fields[i] = strdup(fields->children[i]->symbol);
+	return rv;
+}
+
+void
+record_type_free(RecordType *type)
+{
+	size_t i;
+
+	if (--type->refs > 0)
+		return;
+
+	for (i = 0; i < type->fields_count; ++i)
+		free(type->fields[i]);
+	free(type->fields);
+	free(type->name);
+	free(type);
+}
+
+static size_t
+record_size(const RecordType *type)
+{
+	return sizeof(Record) + sizeof(Value *) * type->fields_count;
+}
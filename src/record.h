@@ -0,0 +1,57 @@
+#ifndef _RECORD_H
+#define _RECORD_H
+
+#include <stdlib.h>
+#include "value.h"
+
+/* Type declared by `defrecord`. Shared by its records and functions */
+typedef struct RecordType {
+	size_t refs;
+	char *name;
+	size_t fields_count;
+	char **fields;
+} RecordType;
+
+/*
+Record of `type` with values of fields in order of declaration. Immutable and
+shared between copies of record value
+*/
+struct Record {
+	size_t refs;
+	RecordType *type;
+	Value *fields[];
+};
+
+typedef enum {
+	RECORD_CONSTRUCTOR,
+	RECORD_PREDICATE,
+	RECORD_ACCESSOR,
+} RecordFunctionKind;
+
+/*
+Function declared by `defrecord` under `name`. Accessor reads field `field`.
+Shared between copies of function value
+*/
+struct RecordFunction {
+	size_t refs;
+	RecordType *type;
+	RecordFunctionKind kind;
+	size_t field;
+	char *name;
+};
+
+Record *record_alloc(RecordType *, Value **);
+Record *record_copy(Record *);
+void record_free(Record *);
+RecordFunction *record_function_alloc(
+	RecordType *,
+	RecordFunctionKind,
+	size_t
+);
+RecordFunction *record_function_copy(RecordFunction *);
+void record_function_free(RecordFunction *);
+Record *record_promote(Record *);
+RecordType *record_type_alloc(const char *, const Value *);
+void record_type_free(RecordType *);
+
+#endif /* _RECORD_H */
@@ -1,48 +1,202 @@
 #include <stdio.h>
 #include "config.h"
 #include "env.h"
+#include "hamt.h"
+#include "hashcons.h"
+#include "memo.h"
+#include "number.h"
+#include "optimize.h"
+#include "output.h"
+#include "pool.h"
+#include "pvector.h"
+#include "record.h"
 #include "utils.h"
 #include "value.h"
+#include "vector.h"
 
 /*
 Because we might use args in the construction of the error message we
 need to make sure we don't delete it until we've created the error value.
 */
-#define ERROR_SYMBOL_ARGS(args, fmt, ...) { \
+#define ERROR_SYMBOL_ARGS(args, count, fmt, ...) { \
 	Value *error = value_error_alloc(fmt, ##__VA_ARGS__); \
-	value_free(args); \
+	value_args_free(args, count); \
 	return error; \
 }
-#define VALIDATE_SYMBOL_ARGS(args, condition, fmt, ...) { \
+#define VALIDATE_SYMBOL_ARGS(args, count, condition, fmt, ...) { \
 	if (!(condition)) { \
-		ERROR_SYMBOL_ARGS(args, fmt, ##__VA_ARGS__); \
+		ERROR_SYMBOL_ARGS(args, count, fmt, ##__VA_ARGS__); \
 	} \
 }
-#define VALIDATE_SYMBOL_ARGS_COUNT(symbol, args, expected) { \
+#define VALIDATE_SYMBOL_ARGS_COUNT(symbol, args, count, expected) { \
 	VALIDATE_SYMBOL_ARGS( \
 		args, \
-		args->children_count == expected, \
+		count, \
+		count == expected, \
 		"%s: Too many arguments. Expected %zu. Got %zu.", \
 		symbol, \
-		expected, \
-		args->children_count \
+		(size_t)expected, \
+		count \
 	); \
 }
-#define VALIDATE_SYMBOL_ARG_TYPE(symbol, args, index, expected) { \
+#define VALIDATE_SYMBOL_ARG_TYPE(symbol, args, count, index, expected) { \
 	VALIDATE_SYMBOL_ARGS( \
 		args, \
-		args->children[index]->type == expected, \
+		count, \
+		args[index]->type == expected, \
 		"%s: Invalid %zu argument type. Expected %s. Got %s.", \
 		symbol, \
-		index, \
+		(size_t)index, \
 		value_type_names[expected], \
-		value_type_names[args->children[index]->type] \
+		value_type_names[args[index]->type] \
 	); \
 }
 
+typedef enum {
+	VALUE_SITE_UNINITIALIZED,
+	VALUE_SITE_ADD,
+	VALUE_SITE_SUBSTRACT,
+	VALUE_SITE_MULTIPLY,
+	VALUE_SITE_DIVIDE,
+	VALUE_SITE_EQ,
+	VALUE_SITE_NE,
+	VALUE_SITE_GT,
+	VALUE_SITE_GE,
+	VALUE_SITE_LT,
+	VALUE_SITE_LE,
+	VALUE_SITE_GENERIC,
+} ValueSiteState;
+
+/*
+Type feedback of binary arithmetic or ordering call. Site is specialized to
+operation on two numbers after observing them and deoptimized back to the
+generic builtin call if other types arrive.
+*/
+struct ValueSite {
+	size_t refs;
+	ValueSiteState state;
+	size_t deopts;
+
+	/*
+	Open addressed table of `case` clauses by hashes of their constant keys.
+	Stores indexes of clauses in the call, zero is empty
+	*/
+	size_t *cases;
+	size_t cases_size;
+};
+
+/*
+Segment of arguments stack. Arguments of a call are contiguous in a single
+segment. Segments are never moved, so a callee keeps its arguments in place
+while it evaluates code.
+*/
+typedef struct ValueStack ValueStack;
+struct ValueStack {
+	ValueStack *previous;
+	ValueStack *next;
+	size_t size;
+	size_t top;
+	Value *values[];
+};
+
+/*
+Values of entries of a map and values of equal keys in `other` map. `eq` is
+cleared if `other` lacks a key
+*/
+typedef struct ValueMapEq {
+	const Hamt *other;
+	unsigned char eq;
+	Value *values;
+	Value *other_values;
+} ValueMapEq;
+
+/*
+Value whose items are visited by iterative traversal: children of expression,
+items of vector or pvector, fields of record or keys and values of map
+flattened to `target`. Otherwise `target` is the copy or the freed expression,
+or, without `value`, the value left to the loop of `value_free` or
+`value_promote`. `other` is the compared value, `hash` is combined from hashes
+of visited items. `mutable` is set if a vector is reached from the value, whose
+hash can't be cached then
+*/
+typedef struct ValueTask {
+	const Value *value;
+	Value *target;
+	const Value *other;
+	size_t index;
+	size_t hash;
+	unsigned char mutable;
+} ValueTask;
+
+/*
+Stack of tasks shared by traversals. A traversal nested in another one, like
+freeing fields of a record, works above the tasks of the outer one
+*/
+typedef struct ValueTasks {
+	ValueTask *items;
+	size_t count;
+	size_t capacity;
+} ValueTasks;
+
+/*
+Container of values which may escape arena of the current top level form.
+Exactly one member is set
+*/
+typedef struct ValueEscape {
+	EnvEntry *entry;
+	Vector *vector;
+	Memo *memo;
+} ValueEscape;
+
+/* Escapes recorded until the outermost arena is left */
+typedef struct ValueEscapes {
+	ValueEscape *items;
+	size_t count;
+	size_t capacity;
+} ValueEscapes;
+
+/*
+Frame reached from bindings of a returning frame. `refs` counts references to
+it from reached frames and closures. `live` is set if it's referenced from
+elsewhere or from a live frame, whose references are followed once `scanned`
+*/
+typedef struct ValueFrame {
+	Env *env;
+	size_t refs;
+	unsigned char live;
+	unsigned char scanned;
+} ValueFrame;
+
+/* Frames reached by the current `value_frame_release` */
+typedef struct ValueFrames {
+	ValueFrame *items;
+	size_t count;
+	size_t capacity;
+} ValueFrames;
+
 /* Entire `Value` */
+static Value *value_alloc(ValueType type);
+static void value_args_free(Value **args, size_t count);
+static void value_copy_hash(Value *to, const Value *from);
+static Value *value_copy_node(const Value *value);
+static unsigned char value_eq_comparing(const Value *x, const Value *y);
+static unsigned char value_eq_node(const Value *x, const Value *y);
+static void value_eq_pop(void);
+static void value_free_node(Value *value);
+static unsigned char value_guard_valid(const Value *value);
+static unsigned char value_hash_large(const Value *value);
+static unsigned char value_hash_node(
+	const Value *value,
+	size_t *hash,
+	unsigned char *mutable
+);
+static size_t value_hash_pop(unsigned char *mutable);
+static Value *value_hashcons(Value *value);
 static void value_print(const Value *value);
-static unsigned char value_eq(const Value *x, const Value *y);
+static void value_print_end(const ValueTask *task);
+static void value_print_node(const Value *value);
+static void value_print_separator(const ValueTask *task);
+static void value_promote_node(Value *value);
 
 /* `Value`'s childs. Usable for expressions */
 static void value_extend_children(Value *to, Value *from);
@@ -53,49 +207,214 @@ static Value *value_free_without_child(Value *value, size_t child_i);
 /* Expressions */
 static void value_expression_print(const Value *value);
 
+/* Frames of returning calls, which may be kept alive by their own closures */
+static void value_frame_reach(Env *env, unsigned char live);
+static void value_frame_release(Env *frame);
+static void value_frame_scan(Env *env, unsigned char live);
+static void value_frame_scan_value(const Value *value, unsigned char live);
+
+/* Stack of iterative traversals */
+static void value_tasks_grow(void);
+static void value_tasks_pop(void);
+static ValueTask *value_tasks_push(const Value *value);
+
+/* Items of expressions and containers visited by traversals */
+static const Value *value_item(const Value *value, size_t i);
+static size_t value_items_count(const Value *value);
+static Value *value_items_alloc(size_t capacity);
+static void value_items_free(Value *items);
+static const Value *value_task_items(const ValueTask *task);
+
+/* Escapes from arena */
+static ValueEscape *value_escapes_push(void);
+
 /* Sexpressions */
-static Value *value_sexpression_eval(Value *value, Env *env);
+static Value *value_sexpression_eval(const Value *value, Env *env);
+static Value *value_site_call(
+	Value **args,
+	size_t count,
+	Env *env,
+	ValueBuiltin builtin,
+	ValueSite *site
+);
+static Value **value_stack_push(size_t count);
+static void value_stack_pop(size_t count);
+static ValueSite *value_site_promote(ValueSite *site);
+static ValueSiteState value_site_specialize(ValueBuiltin builtin);
+
+/* Special forms */
+static const Value *value_form_code(
+	const Value *value,
+	size_t index,
+	Env *env,
+	Value **owned
+);
+static Value *value_form_case(const Value *value, Env *env);
+static Value *value_form_condition_chain(
+	const Value *value,
+	Env *env,
+	unsigned char or
+);
+static Value *value_form_for(const Value *value, Env *env, unsigned char times);
+static Value *value_form_if(const Value *value, Env *env);
+static Value *value_form_let(const Value *value, Env *env);
+static Value *value_form_select(const Value *value, Env *env);
+static Value *value_form_while(const Value *value, Env *env);
+static Value *value_while_loop(
+	const Value *condition,
+	const Value *body,
+	Env *env
+);
+static Value *value_for_loop(
+	const Value **code,
+	Env *env,
+	unsigned char times
+);
+
+/* Clauses of `select` and `case` */
+static Value *value_case_clause(
+	const Value *x,
+	const Value *clause,
+	size_t index,
+	Env *env
+);
+static size_t value_case_lookup(const Value *value, const Value *x);
+static ValueSite *value_case_site_alloc(const Value *value);
+static Value *value_clause_check(
+	const char *symbol,
+	const Value *clause,
+	size_t index
+);
+static Value *value_select_clause(
+	const Value *clause,
+	size_t index,
+	Env *env
+);
+
+/* Scopes */
+static Value *value_let_eval(const Value *body, Env *env);
 
 /* Functions */
-static Value *value_function_call(Value *f, Env *env, Value *args);
+static Value *value_function_call(
+	Value *f,
+	Env *env,
+	Value **args,
+	size_t count
+);
+static Value *value_lambda_call(
+	Value *f,
+	Value **args,
+	size_t count,
+	size_t given
+);
+static Value *value_memo_call(
+	Value *f,
+	Env *env,
+	Value **args,
+	size_t count
+);
 static void value_function_print(const Value *value);
-static Value *value_lambda_alloc(Value *args, Value *body);
+static Value *value_lambda_alloc(Value *args, Value *body, Env *env);
+static ValueLambda *value_lambda_promote(ValueLambda *lambda);
+static void value_memo_escape(Memo *memo);
 
 /* Strings */
 static void value_string_print(const Value *value);
 static Value *value_string_read(const mpc_ast_t *ast);
 
+/* Maps */
+static unsigned char value_map_key_valid(const Value *key);
+static void value_map_eq_visit(const Value *key, const Value *value, void *data);
+static Value *value_map_flatten(const Value *value);
+static void value_map_flatten_visit(
+	const Value *key,
+	const Value *value,
+	void *data
+);
+static void value_map_keys_visit(
+	const Value *key,
+	const Value *value,
+	void *data
+);
+static void value_map_print(const Value *value);
+
+/* Vectors */
+static unsigned char value_index_valid(const Value *index, size_t count);
+static void value_pvector_print(const Value *value);
+static void value_vector_escape(Vector *vector, size_t index);
+static void value_vector_print(const Value *value);
+
+/* Records */
+static Value *value_record_call(
+	const RecordFunction *function,
+	Value **args,
+	size_t count
+);
+static void value_record_define(
+	Env *env,
+	RecordType *type,
+	RecordFunctionKind kind,
+	size_t field
+);
+static void value_record_print(const Value *value);
+
 /* Symbol */
 static Value *value_symbol_arithmetic_eval(
 	const char *symbol,
-	Value *value,
+	Value **args,
+	size_t count,
 	const Env *env
 );
 static Value *value_symbol_cmp_eval(
 	const char *symbol,
-	Value *value,
+	Value **args,
+	size_t count,
 	const Env *env
 );
 static Value *value_symbol_condition_chain_eval(
 	const char *symbol,
-	Value *value,
+	Value **args,
+	size_t count,
 	const Env *env
 );
 static Value *value_symbol_ordering_eval(
 	const char *symbol,
-	Value *value,
+	Value **args,
+	size_t count,
 	const Env *env
 );
 static Value *value_symbol_variable_eval(
 	const char *symbol,
-	Value *value,
+	Value **args,
+	size_t count,
 	Env *env
 );
 
 /* Number */
 static Value *value_number_alloc(ValueNumber number);
+static unsigned char value_number_integer(const Value *value);
 static Value *value_number_read(const mpc_ast_t *ast);
 
+/* Current segment of arguments stack */
+static ValueStack *value_stack = NULL;
+
+/* Tasks of iterative traversals */
+static ValueTasks value_tasks = {NULL, 0, 0};
+
+/*
+Set while the loop of `value_free` or `value_promote` runs. Nested calls from
+containers leave their values to the loop, so nesting of containers is not
+limited by the native stack
+*/
+static unsigned char value_freeing = 0;
+static unsigned char value_promoting = 0;
+
+/* Containers changed by the current top level form */
+static ValueEscapes value_escapes = {NULL, 0, 0};
+
+/* Frames reached from the returning frame */
+static ValueFrames value_frames = {NULL, 0, 0};
+
 const char *value_type_names[] = {
 	[ERROR_TYPE] = "Error",
 	[FUNCTION_TYPE] = "Function",
@@ -104,12 +423,17 @@ const char *value_type_names[] = {
 	[SEXPRESSION_TYPE] = "Sexpression",
 	[STRING_TYPE] = "String",
 	[SYMBOL_TYPE] = "Symbol",
+	[VECTOR_TYPE] = "Vector",
+	[PVECTOR_TYPE] = "Pvector",
+	[MAP_TYPE] = "Map",
+	[RECORD_TYPE] = "Record",
 };
 
 void
 value_add_child(Value *value, Value *child)
 {
 	/* Reallocate memory with new size and add child to end */
+	value->hashed = 0;
 	++value->children_count;
 	value->children = realloc(
 		value->children,
@@ -118,144 +442,397 @@ value_add_child(Value *value, Value *child)
 	value->children[value->children_count - 1] = child;
 }
 
-Value*
-value_copy(const Value *value)
+/* Item `i` of expression, vector, pvector or record `value`. */
+static const Value*
+value_item(const Value *value, size_t i)
 {
-	size_t i;
+	switch (value->type) {
+	case VECTOR_TYPE:
+		return value->vector->items[i];
+	case PVECTOR_TYPE:
+		return pvector_nth(value->pvector, i);
+	case RECORD_TYPE:
+		return value->record->fields[i];
+	default:
+		return value->children[i];
+	}
+}
 
-	/* Alocate new value and set type to it */
-	Value *new_value = malloc(sizeof(Value));
-	new_value->type = value->type;
+/*
+Allocates qexpression for `capacity` items borrowed from other values. It is
+freed by `value_items_free`.
+*/
+static Value*
+value_items_alloc(size_t capacity)
+{
+	Value *rv = value_expression_alloc(QEXPRESSION_TYPE);
+
+	rv->children = malloc(sizeof(Value *) * capacity);
+	return rv;
+}
 
+/* Count of items of expression, vector, pvector or record `value`. */
+static size_t
+value_items_count(const Value *value)
+{
 	switch (value->type) {
-	case ERROR_TYPE:
-		/* Copy error message */
-		new_value->error = strdup(value->error);
-		break;
-	case FUNCTION_TYPE:
-		if (value->builtin) {
-			/* Copy builtin's pointer */
-			new_value->builtin = value->builtin;
+	case VECTOR_TYPE:
+		return value->vector->count;
+	case PVECTOR_TYPE:
+		return value->pvector->count;
+	case RECORD_TYPE:
+		return value->record->type->fields_count;
+	default:
+		return value->children_count;
+	}
+}
+
+/* Frees qexpression of borrowed items without the items. */
+static void
+value_items_free(Value *items)
+{
+	free(items->children);
+	pool_free(items, sizeof(Value));
+}
+
+/* Enters arena of top level evaluation. */
+void
+value_arena_begin(void)
+{
+	pool_arena_begin();
+}
+
+/*
+Leaves arena of top level evaluation. When the outermost arena is left,
+values put to globals, vectors and caches by the form are promoted before
+arena is reset. Promotion is deferred until then, because frames of running
+calls are still changed.
+*/
+void
+value_arena_end(void)
+{
+	size_t i;
+	ValueEscape *escape;
+
+	if (!pool_arena_end())
+		return;
+
+	for (i = 0; i < value_escapes.count; ++i) {
+		escape = &value_escapes.items[i];
+		if (escape->entry) {
+			escape->entry->value = value_promote(escape->entry->value);
+		} else if (escape->vector) {
+			/* Vector referenced only by the escape is garbage */
+			if (escape->vector->refs > 1)
+				vector_promote_changed(escape->vector);
+			vector_free(escape->vector);
 		} else {
-			/* Copy lambda */
-			new_value->env = env_copy(value->env);
-			new_value->lambda_formals = value_copy(value->lambda_formals);
-			new_value->lambda_body = value_copy(value->lambda_body);
-			new_value->builtin = NULL;
+			escape->memo->escaped = 0;
+			if (escape->memo->refs > 1)
+				memo_promote_recent(escape->memo);
+			memo_free(escape->memo);
 		}
-		break;
-	case NUMBER_TYPE:
-		new_value->number = value->number;
-		break;
-	case SEXPRESSION_TYPE: /* FALLTHROUGH */
-	case QEXPRESSION_TYPE:
-		/* Copy children */
-		new_value->children_count = value->children_count;
-		new_value->children = malloc(sizeof(Value *) * value->children_count);
-		for (i = 0; i < value->children_count; ++i)
-			new_value->children[i] = value_copy(value->children[i]);
-		break;
-	case STRING_TYPE:
-		/* Copy string */
-		new_value->string = strdup(value->string);
-		break;
-	case SYMBOL_TYPE:
-		/* Copy symbol */
-		new_value->symbol = strdup(value->symbol);
-		break;
 	}
+	value_escapes.count = 0;
+	pool_arena_reset();
+}
 
-	return new_value;
+/*
+Records global `entry` bound by the current top level form. Its value is
+promoted when the outermost arena is left.
+*/
+void
+value_arena_escape(EnvEntry *entry)
+{
+	if (pool_forward(entry))
+		return;
+	pool_forward_set(entry, entry);
+	value_escapes_push()->entry = entry;
+}
+
+/*
+Copies `value`. Children of expressions are copied by a loop over the stack of
+tasks, so depth of the value is not limited by the native stack.
+*/
+Value*
+value_copy(const Value *value)
+{
+	size_t base = value_tasks.count;
+	Value **slot,
+		*rv;
+	ValueTask *task;
+
+	slot = &rv;
+	do {
+		*slot = value_copy_node(value);
+
+		/* Take the next child of the innermost unfinished expression */
+		value = NULL;
+		while (!value && value_tasks.count > base) {
+			task = &value_tasks.items[value_tasks.count - 1];
+			if (task->index < task->value->children_count) {
+				value = task->value->children[task->index];
+				slot = &task->target->children[task->index++];
+			} else {
+				--value_tasks.count;
+			}
+		}
+	} while (value);
+	return rv;
 }
 
 Value*
 value_error_alloc(char *fmt, ...)
 {
-	Value *value = malloc(sizeof(Value));
+	char buffer[ERROR_BUFFER_SIZE];
+	Value *value = value_alloc(ERROR_TYPE);
 	va_list va;
 	va_start(va, fmt);
 
-	/* Allocate error value */
-	value->error = malloc(ERROR_BUFFER_SIZE);
-	value->type = ERROR_TYPE;
-
 	/* Format error message and fit it in memory */
-	vsnprintf(value->error, ERROR_BUFFER_SIZE - 1, fmt, va);
-	value->error = realloc(value->error, strlen(value->error) + 1);
+	vsnprintf(buffer, ERROR_BUFFER_SIZE - 1, fmt, va);
+	value->error = pool_strdup(buffer);
 
 	va_end(va);
 	return value;
 }
 
+/*
+Compares `x` and `y` structurally. Items of expressions and containers are
+compared by a loop.
+*/
+unsigned char
+value_eq(const Value *x, const Value *y)
+{
+	size_t i,
+		base = value_tasks.count;
+	unsigned char eq;
+	const Value *items;
+	ValueTask *task;
+
+	do {
+		eq = value_eq_node(x, y);
+
+		/* Take the next items of the innermost unfinished values */
+		x = NULL;
+		while (eq && !x && value_tasks.count > base) {
+			task = &value_tasks.items[value_tasks.count - 1];
+			items = value_task_items(task);
+			if (task->index < value_items_count(items)) {
+				i = task->index++;
+				x = value_item(items, i);
+				y = value_item(task->other, i);
+			} else {
+				value_eq_pop();
+			}
+		}
+	} while (x);
+
+	/* Drop tasks left after the first difference */
+	while (value_tasks.count > base)
+		value_eq_pop();
+	return eq;
+}
+
+/*
+Evaluates code `value` without modifying it, so the same code may be
+evaluated many times. Returns fresh result.
+*/
 Value*
-value_eval(Value *value, Env *env)
+value_eval(const Value *value, Env *env)
 {
-	Value *symbol_value;
+	Value *rv;
 
 	switch (value->type) {
-	case SYMBOL_TYPE:
-		/* Get value from env and return it */
-		symbol_value = env_get(env, value);
-		value_free(value);
-		return symbol_value;
 	case SEXPRESSION_TYPE:
 		return value_sexpression_eval(value, env);
+	case QEXPRESSION_TYPE:
+		return value_copy(value);
 	default:
-		return value;
+		break;
 	}
+
+	/* Evaluate original code if globals it depends on were redefined */
+	if (value->origin && !value_guard_valid(value))
+		return value_eval(value->origin, env);
+
+	if (value->type == SYMBOL_TYPE)
+		return env_get(env, value);
+
+	/* Result of folded constant doesn't need its guard anymore */
+	rv = value_copy(value);
+	if (rv->origin) {
+		value_free(rv->origin);
+		rv->origin = NULL;
+	}
+	return rv;
 }
 
 Value*
 value_expression_alloc(ValueType type)
 {
-	Value *value = malloc(sizeof(Value));
-	value->type = type;
+	Value *value = value_alloc(type);
 	value->children_count = 0;
 	value->children = NULL;
+	value->site = NULL;
 	return value;
 }
 
+/*
+Frees `value`. Children of expressions are freed by a loop, each expression is
+freed after its children. Items of containers released in the loop are freed
+by it too.
+*/
 void
 value_free(Value *value)
 {
-	size_t i;
-
-	if (value->type == SEXPRESSION_TYPE || value->type == QEXPRESSION_TYPE) {
-		/* Free children */
-		for (i = 0; i < value->children_count; ++i)
-			value_free(value->children[i]);
-	} else if (value->type == ERROR_TYPE) {
-		/* Free allocated error message */
-		free(value->error);
-	} else if (value->type == FUNCTION_TYPE && !value->builtin) {
-		/* Free lambda */
-		env_free(value->env);
-		value_free(value->lambda_formals);
-		value_free(value->lambda_body);
-	} else if (value->type == STRING_TYPE) {
-		/* Free allocated string */
-		free(value->string);
-	} else if (value->type == SYMBOL_TYPE) {
-		/* Free allocated symbol */
-		free(value->symbol);
+	Value *expression;
+	size_t base = value_tasks.count;
+	ValueTask *task;
+
+	/* Task without value holds value left by a nested call */
+	if (value_freeing) {
+		value_tasks_push(NULL)->target = value;
+		return;
 	}
-	free(value);
+
+	value_freeing = 1;
+	do {
+		value_free_node(value);
+
+		/* Take the next child or free the expression after its children */
+		value = NULL;
+		while (!value && value_tasks.count > base) {
+			task = &value_tasks.items[value_tasks.count - 1];
+			if (!task->value) {
+				value = task->target;
+				--value_tasks.count;
+			} else if (task->index < task->target->children_count) {
+				value = task->target->children[task->index++];
+			} else {
+				expression = task->target;
+				--value_tasks.count;
+				free(expression->children);
+				pool_free(expression, sizeof(Value));
+			}
+		}
+	} while (value);
+	value_freeing = 0;
+}
+
+/*
+Structural hash of `value`. Values equal by `value_eq` have equal hashes.
+Items of expressions and containers are hashed by a loop.
+
+Hash of expression or string is cached in `value`. The cache is not a part of
+the value, so it is filled in through const pointer. Hash of expression which
+reaches a vector isn't cached, because the vector may be changed.
+*/
+size_t
+value_hash(const Value *value)
+{
+	size_t hash,
+		base = value_tasks.count;
+	unsigned char done,
+		mutable;
+	const Value *items;
+	ValueTask *task;
+
+	do {
+		done = value_hash_node(value, &hash, &mutable);
+
+		/* Add hash of the finished item and take the next one */
+		value = NULL;
+		while (!value && value_tasks.count > base) {
+			task = &value_tasks.items[value_tasks.count - 1];
+
+			/* Order of entries of map doesn't matter */
+			if (done && task->value->type == MAP_TYPE)
+				task->hash += task->index % 2 ? hash * 31 : hash;
+			else if (done)
+				task->hash = hash + 31 * task->hash;
+			if (done)
+				task->mutable |= mutable;
+
+			items = value_task_items(task);
+			done = task->index == value_items_count(items);
+			if (done)
+				hash = value_hash_pop(&mutable);
+			else
+				value = value_item(items, task->index++);
+		}
+	} while (value);
+	return hash;
 }
 
 Value*
 value_builtin_alloc(ValueBuiltin builtin)
 {
-	Value *value = malloc(sizeof(Value));
-	value->type = FUNCTION_TYPE;
+	Value *value = value_alloc(FUNCTION_TYPE);
 	value->builtin = builtin;
+	value->memo = NULL;
+	value->record_function = NULL;
 	return value;
 }
 
+/*
+Returns `value` to be changed in place by its owner. Shared hash-consed value
+is replaced by its plain copy, whose children stay shared.
+*/
+Value*
+value_own(Value *value)
+{
+	unsigned int refs = value->refs;
+	Value *rv;
+
+	if (refs == 0) {
+		return value;
+	} else if (refs == 1) {
+		/* The only copy is taken out of the table and may refer to arena */
+		hashcons_remove(value);
+		value->refs = 0;
+		value->promoted = 0;
+		return value;
+	}
+
+	/* Copy is plain, so children of the copy are shared instead */
+	value->refs = 0;
+	rv = value_copy(value);
+	value->refs = refs - 1;
+	return rv;
+}
+
 void
 value_println(const Value *value)
 {
 	value_print(value);
-	putchar('\n');
+	output_char('\n');
+}
+
+/*
+Moves `value` and everything it refers to out of arena. Returns its new
+address. What moved values refer to is moved by a loop.
+*/
+Value*
+value_promote(Value *value)
+{
+	size_t base = value_tasks.count;
+	Value *rv;
+
+	/* Hash-consed value is moved out of arena when consed */
+	if (value->refs || value->promoted)
+		return value;
+	rv = pool_promote(value, sizeof(Value));
+	rv->promoted = 1;
+	value_tasks_push(NULL)->target = rv;
+	if (value_promoting)
+		return rv;
+
+	value_promoting = 1;
+	while (value_tasks.count > base)
+		value_promote_node(value_tasks.items[--value_tasks.count].target);
+	value_promoting = 0;
+	return rv;
 }
 
 Value*
@@ -293,130 +870,280 @@ value_read(const mpc_ast_t *ast)
 		value_add_child(value, value_read(ast->children[i]));
 	}
 
+	/* Collect type feedback of binary arithmetic and ordering calls */
+	if (
+		value->children_count == 3
+		&& value->children[0]->type == SYMBOL_TYPE
+		&& value->children[0]->builtin
+		&& value_site_specialize(value->children[0]->builtin)
+			!= VALUE_SITE_GENERIC
+	) {
+		value->site = pool_alloc(sizeof(ValueSite));
+		value->site->refs = 1;
+		value->site->state = VALUE_SITE_UNINITIALIZED;
+		value->site->deopts = 0;
+		value->site->cases = NULL;
+		value->site->cases_size = 0;
+	} else if (
+		value->children_count >= 3
+		&& value->children[0]->type == SYMBOL_TYPE
+		&& value->children[0]->builtin == value_symbol_case_eval
+	) {
+		/* Dispatch `case` on constant keys through a table */
+		value->site = value_case_site_alloc(value);
+	}
+
+	/* Deduplicate read data */
+	if (hashcons_enabled && value->type == QEXPRESSION_TYPE)
+		return value_hashcons(value);
 	return value;
 }
 
 Value*
 value_string_alloc(const char *s)
 {
-	Value *rv = malloc(sizeof(Value));
-	rv->type = STRING_TYPE;
-	rv->string = strdup(s);
+	Value *rv = value_alloc(STRING_TYPE);
+	rv->string = pool_strdup(s);
 	return rv;
 }
 
 Value*
-value_symbol_add_eval(Value *value, Env *env)
+value_symbol_add_eval(Value **args, size_t count, Env *env)
 {
-	return value_symbol_arithmetic_eval("+", value, env);
+	return value_symbol_arithmetic_eval("+", args, count, env);
 }
 
 Value*
 value_symbol_alloc(const char *symbol)
 {
-	Value *value = malloc(sizeof(Value));
-	value->type = SYMBOL_TYPE;
-	value->symbol = strdup(symbol);
+	Value *value = value_alloc(SYMBOL_TYPE);
+	value->symbol = pool_strdup(symbol);
+	value->slot = env_intern(symbol);
+	value->builtin = env_builtin_lookup(symbol);
 	return value;
 }
 
 Value*
-value_symbol_and_eval(Value *value, Env *env)
+value_symbol_and_eval(Value **args, size_t count, Env *env)
 {
-	return value_symbol_condition_chain_eval("&&", value, env);
+	return value_symbol_condition_chain_eval("&&", args, count, env);
 }
 
 Value*
-value_symbol_def_eval(Value *value, Env *env)
+value_symbol_case_eval(Value **args, size_t count, Env *env)
 {
-	return value_symbol_variable_eval("def", value, env);
+	size_t i;
+	Value *result = NULL;
+
+	VALIDATE_SYMBOL_ARGS(
+		args,
+		count,
+		count >= 1,
+		"case: Required at least one value."
+	);
+
+	for (i = 1; i < count && !result; ++i)
+		result = value_case_clause(args[0], args[i], i, env);
+
+	value_args_free(args, count);
+	return result ? result : value_error_alloc("No case found.");
 }
 
 Value*
-value_symbol_divide_eval(Value *value, Env *env)
+value_symbol_def_eval(Value **args, size_t count, Env *env)
 {
-	return value_symbol_arithmetic_eval("/", value, env);
+	return value_symbol_variable_eval("def", args, count, env);
 }
 
+/*
+Declares record type with name and fields given by symbols. Defines globally
+its constructor named as the type, predicate `name?` and accessors
+`name-field`.
+*/
 Value*
-value_symbol_error_eval(Value *value, Env *env)
+value_symbol_defrecord_eval(Value **args, size_t count, Env *env)
 {
-	(void)env;
-	VALIDATE_SYMBOL_ARGS_COUNT("error", value, 1);
-	VALIDATE_SYMBOL_ARG_TYPE("error", value, 0, STRING_TYPE);
-	ERROR_SYMBOL_ARGS(value, value->children[0]->string);
+	size_t i,
+		j;
+	const Value *fields;
+	RecordType *type;
+
+	VALIDATE_SYMBOL_ARGS_COUNT("defrecord", args, count, 2);
+	VALIDATE_SYMBOL_ARG_TYPE("defrecord", args, count, 0, QEXPRESSION_TYPE);
+	VALIDATE_SYMBOL_ARG_TYPE("defrecord", args, count, 1, QEXPRESSION_TYPE);
+	VALIDATE_SYMBOL_ARGS(
+		args,
+		count,
+		args[0]->children_count == 1
+			&& args[0]->children[0]->type == SYMBOL_TYPE,
+		"defrecord: Name must be a single symbol."
+	);
+
+	fields = args[1];
+	for (i = 0; i < fields->children_count; ++i) {
+		VALIDATE_SYMBOL_ARGS(
+			args,
+			count,
+			fields->children[i]->type == SYMBOL_TYPE,
+			"defrecord: Invalid type for %zu field. Expected %s. Got %s.",
+			i,
+			value_type_names[SYMBOL_TYPE],
+			value_type_names[fields->children[i]->type]
+		);
+		for (j = 0; j < i; ++j)
+			VALIDATE_SYMBOL_ARGS(
+				args,
+				count,
+				strcmp(
+					fields->children[i]->symbol,
+					fields->children[j]->symbol
+				) != 0,
+				"defrecord: Duplicate field %s.",
+				fields->children[i]->symbol
+			);
+	}
+
+	type = record_type_alloc(args[0]->children[0]->symbol, fields);
+	value_record_define(env, type, RECORD_CONSTRUCTOR, 0);
+	value_record_define(env, type, RECORD_PREDICATE, 0);
+	for (i = 0; i < type->fields_count; ++i)
+		value_record_define(env, type, RECORD_ACCESSOR, i);
+	record_type_free(type);
+
+	value_args_free(args, count);
+	return value_expression_alloc(SEXPRESSION_TYPE);
 }
 
 Value*
-value_symbol_eval_eval(Value *value, Env *env)
+value_symbol_divide_eval(Value **args, size_t count, Env *env)
 {
-	Value *arg;
+	return value_symbol_arithmetic_eval("/", args, count, env);
+}
 
-	VALIDATE_SYMBOL_ARGS_COUNT("eval", value, 1);
-	VALIDATE_SYMBOL_ARG_TYPE("eval", value, 0, QEXPRESSION_TYPE);
+/* Returns the last argument. Other arguments are evaluated for effects. */
+Value*
+value_symbol_do_eval(Value **args, size_t count, Env *env)
+{
+	(void)env;
 
-	/* Set sexpression type to argument and eval it */
-	arg = value_free_without_child(value, 0);
-	arg->type = SEXPRESSION_TYPE;
-	return value_eval(arg, env);
+	if (count == 0)
+		return value_expression_alloc(QEXPRESSION_TYPE);
+	value_args_free(args, count - 1);
+	return args[count - 1];
 }
 
+/* Evaluates body with counter from zero up to the bound. */
 Value*
-value_symbol_eq_eval(Value *value, Env *env)
+value_symbol_dotimes_eval(Value **args, size_t count, Env *env)
 {
-	return value_symbol_cmp_eval("==", value, env);
+	Value *result;
+
+	VALIDATE_SYMBOL_ARGS_COUNT("dotimes", args, count, 3);
+	result = value_for_loop((const Value **)args, env, 1);
+	value_args_free(args, count);
+	return result;
 }
 
 Value*
-value_symbol_ge_eval(Value *value, Env *env)
+value_symbol_error_eval(Value **args, size_t count, Env *env)
 {
-	return value_symbol_ordering_eval(">=", value, env);
+	(void)env;
+	VALIDATE_SYMBOL_ARGS_COUNT("error", args, count, 1);
+	VALIDATE_SYMBOL_ARG_TYPE("error", args, count, 0, STRING_TYPE);
+	ERROR_SYMBOL_ARGS(args, count, "%s", args[0]->string);
 }
 
 Value*
-value_symbol_gt_eval(Value *value, Env *env)
+value_symbol_eval_eval(Value **args, size_t count, Env *env)
 {
-	return value_symbol_ordering_eval(">", value, env);
+	Value *result;
+
+	VALIDATE_SYMBOL_ARGS_COUNT("eval", args, count, 1);
+	VALIDATE_SYMBOL_ARG_TYPE("eval", args, count, 0, QEXPRESSION_TYPE);
+
+	/* Eval argument as sexpression */
+	result = value_sexpression_eval(args[0], env);
+	value_free(args[0]);
+	return result;
 }
 
 Value*
-value_symbol_head_eval(Value *value, Env *env)
+value_symbol_eq_eval(Value **args, size_t count, Env *env)
 {
-	(void)env;
+	return value_symbol_cmp_eval("==", args, count, env);
+}
 
-	Value *arg,
-		*new_value;
+/* Evaluates body with counter from the first bound up to the second. */
+Value*
+value_symbol_for_eval(Value **args, size_t count, Env *env)
+{
+	Value *result;
 
-	VALIDATE_SYMBOL_ARGS_COUNT("head", value, 1);
+	VALIDATE_SYMBOL_ARGS_COUNT("for", args, count, 4);
+	result = value_for_loop((const Value **)args, env, 0);
+	value_args_free(args, count);
+	return result;
+}
 
-	arg = value_free_without_child(value, 0);
+Value*
+value_symbol_ge_eval(Value **args, size_t count, Env *env)
+{
+	return value_symbol_ordering_eval(">=", args, count, env);
+}
 
-	if (arg->type == QEXPRESSION_TYPE) {
-		/* Validate a size */
-		VALIDATE_SYMBOL_ARGS(
-			value,
+Value*
+value_symbol_gt_eval(Value **args, size_t count, Env *env)
+{
+	return value_symbol_ordering_eval(">", args, count, env);
+}
+
+Value*
+value_symbol_head_eval(Value **args, size_t count, Env *env)
+{
+	(void)env;
+
+	Value *arg,
+		*new_value;
+
+	VALIDATE_SYMBOL_ARGS_COUNT("head", args, count, 1);
+
+	arg = args[0];
+	if (arg->type == QEXPRESSION_TYPE) {
+		/* Validate a size */
+		VALIDATE_SYMBOL_ARGS(
+			args,
+			count,
 			arg->children_count != 0,
 			"head: Argument is empty."
 		);
 
 		/* Put first argument's child to new allocated qexpression */
 		new_value = value_expression_alloc(QEXPRESSION_TYPE);
-		value_add_child(new_value, value_free_without_child(arg, 0));
+		if (arg->refs) {
+			/* Child of hash-consed value is shared instead */
+			value_add_child(new_value, value_copy(arg->children[0]));
+			value_free(arg);
+		} else {
+			value_add_child(new_value, value_free_without_child(arg, 0));
+		}
 	} else if (arg->type == STRING_TYPE) {
 		/* Validate a size */
 		VALIDATE_SYMBOL_ARGS(
-			value,
+			args,
+			count,
 			strlen(arg->string) != 0,
 			"head: Argument is empty."
 		);
 
-		/* Extract first char */
+		/* Cut off all chars except first */
+		arg = value_own(arg);
 		arg->string[1] = '\0';
-		new_value = value_copy(arg);
-		value_free(arg);
+		arg->hashed = 0;
+		new_value = arg;
 	} else {
 		ERROR_SYMBOL_ARGS(
-			arg,
+			args,
+			count,
 			"head: Invalid arg type. Expected %s or %s. Got %s.",
 			value_type_names[QEXPRESSION_TYPE],
 			value_type_names[STRING_TYPE],
@@ -428,61 +1155,58 @@ value_symbol_head_eval(Value *value, Env *env)
 }
 
 Value*
-value_symbol_if_eval(Value *value, Env *env)
+value_symbol_if_eval(Value **args, size_t count, Env *env)
 {
 	Value *result;
 
-	VALIDATE_SYMBOL_ARGS_COUNT("if", value, 3);
-	VALIDATE_SYMBOL_ARG_TYPE("if", value, 0, NUMBER_TYPE);
-	VALIDATE_SYMBOL_ARG_TYPE("if", value, 1, QEXPRESSION_TYPE);
-	VALIDATE_SYMBOL_ARG_TYPE("if", value, 1, QEXPRESSION_TYPE);
-
-	value->children[1]->type = SEXPRESSION_TYPE;
-	value->children[2]->type = SEXPRESSION_TYPE;
-
-	if (value->children[0]->number)
-		result = value_eval(value_pop_child(value, 1), env);
-	else
-		result = value_eval(value_pop_child(value, 2), env);
+	VALIDATE_SYMBOL_ARGS_COUNT("if", args, count, 3);
+	VALIDATE_SYMBOL_ARG_TYPE("if", args, count, 0, NUMBER_TYPE);
+	VALIDATE_SYMBOL_ARG_TYPE("if", args, count, 1, QEXPRESSION_TYPE);
+	VALIDATE_SYMBOL_ARG_TYPE("if", args, count, 2, QEXPRESSION_TYPE);
 
-	value_free(value);
+	result = value_sexpression_eval(args[args[0]->number ? 1 : 2], env);
+	value_args_free(args, count);
 	return result;
 }
 
 Value*
-value_symbol_input_eval(Value *value, Env *env)
+value_symbol_input_eval(Value **args, size_t count, Env *env)
 {
 	(void)env;
 
 	size_t length;
-	char *buffer;
+	char *buffer,
+		number[NUMBER_BUFFER_SIZE];
 
-	VALIDATE_SYMBOL_ARGS_COUNT("input", value, 2);
-	VALIDATE_SYMBOL_ARG_TYPE("input", value, 0, STRING_TYPE);
-	VALIDATE_SYMBOL_ARG_TYPE("input", value, 1, NUMBER_TYPE);
+	VALIDATE_SYMBOL_ARGS_COUNT("input", args, count, 2);
+	VALIDATE_SYMBOL_ARG_TYPE("input", args, count, 0, STRING_TYPE);
+	VALIDATE_SYMBOL_ARG_TYPE("input", args, count, 1, NUMBER_TYPE);
+	number_format(args[1]->number, number);
 	VALIDATE_SYMBOL_ARGS(
-		value,
-		value->children[1]->number >= 1,
-		"input: Length must be >= 1. Got %f.",
-		value->children[1]->number
+		args,
+		count,
+		args[1]->number >= 1,
+		"input: Length must be >= 1. Got %s.",
+		number
 	);
 
 	/* Allocate the buffer. +2 for '\n' and '\0' */
-	length = (size_t)value->children[1]->number;
+	length = (size_t)args[1]->number;
 	buffer = malloc(length + 2);
 
 	/* Print a prompt */
-	printf("%s", value->children[0]->string);
-	fflush(stdout);
+	output_string(args[0]->string);
+	output_flush();
 
 	/* Read an input. +1 for '\n' */
 	if (!fgets(buffer, length + 1, stdin)) {
-		ERROR_SYMBOL_ARGS(value, "Failed to input.");
+		free(buffer);
+		ERROR_SYMBOL_ARGS(args, count, "Failed to input.");
 	}
 	fflush(stdin);
 
 	/* Free args */
-	value_free(value);
+	value_args_free(args, count);
 
 	/* Remove '\n' and allocate new string */
 	buffer[strcspn(buffer, "\n")] = '\0';
@@ -490,111 +1214,135 @@ value_symbol_input_eval(Value *value, Env *env)
 }
 
 Value*
-value_symbol_join_eval(Value *value, Env *env)
+value_symbol_join_eval(Value **args, size_t count, Env *env)
 {
 	(void)env;
 
 	size_t i;
-	Value *left;
 
 	VALIDATE_SYMBOL_ARGS(
-		value,
-		value->children_count >= 2,
+		args,
+		count,
+		count >= 2,
 		"join: Invalid args count. Expected at least 2. Got %zu.",
-		value->children_count
+		count
 	);
-	if (value->children[0]->type == QEXPRESSION_TYPE) {
-		for (i = 0; i < value->children_count; ++i)
-			VALIDATE_SYMBOL_ARG_TYPE("join", value, i, QEXPRESSION_TYPE);
+	if (args[0]->type == QEXPRESSION_TYPE) {
+		for (i = 0; i < count; ++i)
+			VALIDATE_SYMBOL_ARG_TYPE("join", args, count, i, QEXPRESSION_TYPE);
 
 		/* Extend first child with other children */
-		left = value_pop_child(value, 0);
-		while (value->children_count > 0)
-			value_extend_children(left, value_pop_child(value, 0));
+		args[0] = value_own(args[0]);
+		for (i = 1; i < count; ++i)
+			value_extend_children(args[0], args[i]);
 	} else {
-		for (i = 0; i < value->children_count; ++i)
-			VALIDATE_SYMBOL_ARG_TYPE("join", value, i, STRING_TYPE);
+		for (i = 0; i < count; ++i)
+			VALIDATE_SYMBOL_ARG_TYPE("join", args, count, i, STRING_TYPE);
 
 		/* Extend first child with other strings */
-		left = value_pop_child(value, 0);
-		while (value->children_count > 0)
-			value_extend_string(left, value_pop_child(value, 0));
+		args[0] = value_own(args[0]);
+		for (i = 1; i < count; ++i)
+			value_extend_string(args[0], args[i]);
 	}
 
-	value_free(value);
-	return left;
+	if (hashcons_enabled)
+		return value_hashcons(args[0]);
+	return args[0];
 }
 
 Value*
-value_symbol_lambda_eval(Value *value, Env *env)
+value_symbol_lambda_eval(Value **args, size_t count, Env *env)
 {
-	(void)env;
-
 	size_t i;
-	Value *formals,
-		*body;
 
-	VALIDATE_SYMBOL_ARGS_COUNT("\\", value, 2);
-	VALIDATE_SYMBOL_ARG_TYPE("\\", value, 0, QEXPRESSION_TYPE);
-	VALIDATE_SYMBOL_ARG_TYPE("\\", value, 1, QEXPRESSION_TYPE);
+	VALIDATE_SYMBOL_ARGS_COUNT("\\", args, count, 2);
+	VALIDATE_SYMBOL_ARG_TYPE("\\", args, count, 0, QEXPRESSION_TYPE);
+	VALIDATE_SYMBOL_ARG_TYPE("\\", args, count, 1, QEXPRESSION_TYPE);
 
-	for (i = 0; i < value->children[0]->children_count; ++i)
+	for (i = 0; i < args[0]->children_count; ++i)
 		VALIDATE_SYMBOL_ARGS(
-			value,
-			value->children[0]->children[i]->type == SYMBOL_TYPE,
+			args,
+			count,
+			args[0]->children[i]->type == SYMBOL_TYPE,
 			"\\: Invalid type for %zu arg. Expected %s. Got %s.",
+			i,
 			value_type_names[SYMBOL_TYPE],
-			value_type_names[value->children[0]->children[i]->type]
+			value_type_names[args[0]->children[i]->type]
 		);
 
-	/* Extract formals and body and allocate new lambda */
-	formals = value_pop_child(value, 0);
-	body = value_pop_child(value, 0);
-	value_free(value);
-	return value_lambda_alloc(formals, body);
+	/* Move formals and body to new lambda */
+	return value_lambda_alloc(args[0], args[1], env);
+}
+
+Value*
+value_symbol_le_eval(Value **args, size_t count, Env *env)
+{
+	return value_symbol_ordering_eval("<=", args, count, env);
 }
 
 Value*
-value_symbol_le_eval(Value *value, Env *env)
+value_symbol_let_eval(Value **args, size_t count, Env *env)
 {
-	return value_symbol_ordering_eval("<=", value, env);
+	Value *result;
+
+	VALIDATE_SYMBOL_ARGS_COUNT("let", args, count, 1);
+	VALIDATE_SYMBOL_ARG_TYPE("let", args, count, 0, QEXPRESSION_TYPE);
+
+	result = value_let_eval(args[0], env);
+	value_free(args[0]);
+	return result;
 }
 
 Value*
-value_symbol_list_eval(Value *value, Env *env)
+value_symbol_list_eval(Value **args, size_t count, Env *env)
 {
 	(void)env;
-	value->type = QEXPRESSION_TYPE;
-	return value;
+
+	Value *rv = value_expression_alloc(QEXPRESSION_TYPE);
+	rv->children = malloc(sizeof(Value *) * count);
+	memcpy(rv->children, args, sizeof(Value *) * count);
+	rv->children_count = count;
+
+	if (hashcons_enabled)
+		return value_hashcons(rv);
+	return rv;
 }
 
 Value*
-value_symbol_load_eval(Value *value, Env *env)
+value_symbol_load_eval(Value **args, size_t count, Env *env)
 {
 	mpc_result_t mpc_result;
 	char *mpc_error;
 	Value *eval_result,
+		*expression,
 		*expressions;
 
-	VALIDATE_SYMBOL_ARGS_COUNT("load", value, 1);
-	VALIDATE_SYMBOL_ARG_TYPE("load", value, 0, STRING_TYPE);
+	VALIDATE_SYMBOL_ARGS_COUNT("load", args, count, 1);
+	VALIDATE_SYMBOL_ARG_TYPE("load", args, count, 0, STRING_TYPE);
 
-	if (mpc_parse_contents(value->children[0]->string, Program, &mpc_result)) {
+	if (mpc_parse_contents(args[0]->string, Program, &mpc_result)) {
 		/* Read contents */
 		expressions = value_read(mpc_result.output);
 		mpc_ast_delete(mpc_result.output);
 
-		/* Evaluate each expression */
+		/* Evaluate each expression in its own arena */
 		while (expressions->children_count > 0) {
-			eval_result = value_eval(value_pop_child(expressions, 0), env);
+			value_arena_begin();
+			expression = value_pop_child(expressions, 0);
+			if (optimize_enabled)
+				expression = optimize(expression, env);
+
+			eval_result = value_eval(expression, env);
 			if (eval_result->type == ERROR_TYPE)
 				value_println(eval_result);
 			value_free(eval_result);
+			value_free(expression);
+			value_arena_end();
 		}
 
 		/* Free expressions and arguments */
 		value_free(expressions);
-		value_free(value);
+		value_args_free(args, count);
 
 		return value_expression_alloc(SEXPRESSION_TYPE);
 	}
@@ -606,394 +1354,2147 @@ value_symbol_load_eval(Value *value, Env *env)
 	/* Return error as value */
 	eval_result = value_error_alloc(
 		"Error loading %s: %s",
-		value->children[0]->string,
+		args[0]->string,
 		mpc_error
 	);
 	free(mpc_error);
-	value_free(value);
+	value_args_free(args, count);
 	return eval_result;
 }
 
 Value*
-value_symbol_lt_eval(Value *value, Env *env)
+value_symbol_lt_eval(Value **args, size_t count, Env *env)
 {
-	return value_symbol_ordering_eval("<", value, env);
+	return value_symbol_ordering_eval("<", args, count, env);
 }
 
+/* Returns value of key, or default value if it is given and key is absent. */
 Value*
-value_symbol_multiply_eval(Value *value, Env *env)
+value_symbol_map_get_eval(Value **args, size_t count, Env *env)
 {
-	return value_symbol_arithmetic_eval("*", value, env);
-}
+	(void)env;
 
-Value*
-value_symbol_ne_eval(Value *value, Env *env)
-{
-	return value_symbol_cmp_eval("!=", value, env);;
+	const Value *value;
+	Value *rv;
+
+	VALIDATE_SYMBOL_ARGS(
+		args,
+		count,
+		count == 2 || count == 3,
+		"map-get: Invalid args count. Expected 2 or 3. Got %zu.",
+		count
+	);
+	VALIDATE_SYMBOL_ARG_TYPE("map-get", args, count, 0, MAP_TYPE);
+
+	value = hamt_get(args[0]->map, args[1], value_hash(args[1]));
+	VALIDATE_SYMBOL_ARGS(
+		args,
+		count,
+		value || count == 3,
+		"map-get: No key found."
+	);
+	if (value) {
+		rv = value_copy(value);
+		value_args_free(args, count);
+	} else {
+		rv = args[2];
+		value_args_free(args, 2);
+	}
+	return rv;
 }
 
 Value*
-value_symbol_not_eval(Value *value, Env *env)
+value_symbol_map_keys_eval(Value **args, size_t count, Env *env)
 {
 	(void)env;
 
-	ValueNumber result;
+	Value *rv;
 
-	VALIDATE_SYMBOL_ARGS_COUNT("!", value, 1);
-	VALIDATE_SYMBOL_ARG_TYPE("!", value, 0, NUMBER_TYPE);
+	VALIDATE_SYMBOL_ARGS_COUNT("map-keys", args, count, 1);
+	VALIDATE_SYMBOL_ARG_TYPE("map-keys", args, count, 0, MAP_TYPE);
 
-	result = !value->children[0]->number;
-	value_free(value);
-	return value_number_alloc(result);
+	rv = value_expression_alloc(QEXPRESSION_TYPE);
+	hamt_each(args[0]->map, value_map_keys_visit, rv);
+	value_args_free(args, count);
+	return rv;
 }
 
+/* Allocates map of alternating keys and values. */
 Value*
-value_symbol_or_eval(Value *value, Env *env)
+value_symbol_map_new_eval(Value **args, size_t count, Env *env)
 {
-	return value_symbol_condition_chain_eval("||", value, env);
+	(void)env;
+
+	size_t i;
+	Value *rv;
+
+	VALIDATE_SYMBOL_ARGS(
+		args,
+		count,
+		count % 2 == 0,
+		"map-new: Expected pairs of keys and values. Got %zu arguments.",
+		count
+	);
+	for (i = 0; i < count; i += 2)
+		VALIDATE_SYMBOL_ARGS(
+			args,
+			count,
+			value_map_key_valid(args[i]),
+			"map-new: Invalid key type %s.",
+			value_type_names[args[i]->type]
+		);
+
+	rv = value_alloc(MAP_TYPE);
+	rv->map = hamt_alloc();
+	for (i = 0; i < count; i += 2)
+		rv->map = hamt_put(rv->map, args[i], value_hash(args[i]), args[i + 1]);
+	return rv;
 }
 
+/* Returns new version with key bound to value. */
 Value*
-value_symbol_print_eval(Value *value, Env *env)
+value_symbol_map_put_eval(Value **args, size_t count, Env *env)
 {
 	(void)env;
 
-	size_t i;
-
-	/* Print args followed by a space */
-	for (i = 0; i < value->children_count; ++i) {
-		value_print(value->children[i]);
-		putchar(' ');
-	}
+	VALIDATE_SYMBOL_ARGS_COUNT("map-put", args, count, 3);
+	VALIDATE_SYMBOL_ARG_TYPE("map-put", args, count, 0, MAP_TYPE);
+	VALIDATE_SYMBOL_ARGS(
+		args,
+		count,
+		value_map_key_valid(args[1]),
+		"map-put: Invalid key type %s.",
+		value_type_names[args[1]->type]
+	);
 
-	/* Print newline, free args and return sexpression */
-	putchar('\n');
-	value_free(value);
-	return value_expression_alloc(SEXPRESSION_TYPE);
+	args[0]->map = hamt_put(
+		args[0]->map,
+		args[1],
+		value_hash(args[1]),
+		args[2]
+	);
+	return args[0];
 }
 
+/* Returns new version without key. */
 Value*
-value_symbol_set_eval(Value *value, Env *env)
+value_symbol_map_remove_eval(Value **args, size_t count, Env *env)
 {
-	return value_symbol_variable_eval("=", value, env);
+	(void)env;
+
+	VALIDATE_SYMBOL_ARGS_COUNT("map-remove", args, count, 2);
+	VALIDATE_SYMBOL_ARG_TYPE("map-remove", args, count, 0, MAP_TYPE);
+
+	args[0]->map = hamt_remove(args[0]->map, args[1], value_hash(args[1]));
+	value_free(args[1]);
+	return args[0];
 }
 
 Value*
-value_symbol_substract_eval(Value *value, Env *env)
+value_symbol_map_size_eval(Value **args, size_t count, Env *env)
 {
-	return value_symbol_arithmetic_eval("-", value, env);
+	(void)env;
+
+	Value *rv;
+
+	VALIDATE_SYMBOL_ARGS_COUNT("map-size", args, count, 1);
+	VALIDATE_SYMBOL_ARG_TYPE("map-size", args, count, 0, MAP_TYPE);
+
+	rv = value_number_alloc(args[0]->map->count);
+	value_args_free(args, count);
+	return rv;
 }
 
 Value*
-value_symbol_tail_eval(Value *value, Env *env)
+value_symbol_memo_eval(Value **args, size_t count, Env *env)
 {
 	(void)env;
 
-	Value *arg;
-
-	VALIDATE_SYMBOL_ARGS_COUNT("tail", value, 1);
-	arg = value_free_without_child(value, 0);
+	size_t capacity = MEMO_DEFAULT_CAPACITY;
+	char number[NUMBER_BUFFER_SIZE];
+	Memo *memo;
+	Value *rv;
 
-	if (arg->type == QEXPRESSION_TYPE) {
+	VALIDATE_SYMBOL_ARGS(
+		args,
+		count,
+		count == 1 || count == 2,
+		"memo: Invalid args count. Expected 1 or 2. Got %zu.",
+		count
+	);
+	VALIDATE_SYMBOL_ARG_TYPE("memo", args, count, 0, FUNCTION_TYPE);
+	VALIDATE_SYMBOL_ARGS(
+		args,
+		count,
+		!args[0]->builtin && !args[0]->memo && !args[0]->record_function,
+		"memo: Function must be a lambda."
+	);
+	if (count == 2) {
+		VALIDATE_SYMBOL_ARG_TYPE("memo", args, count, 1, NUMBER_TYPE);
+		number_format(args[1]->number, number);
 		VALIDATE_SYMBOL_ARGS(
-			value,
-			arg->children_count != 0,
-			"tail: Argument is empty."
+			args,
+			count,
+			value_number_integer(args[1]),
+			"memo: Capacity must be an integer."
 		);
-		value_free(value_pop_child(arg, 0));
-	} else if (arg->type == STRING_TYPE) {
 		VALIDATE_SYMBOL_ARGS(
-			value,
-			strlen(arg->string) != 0,
-			"tail: Argument is empty."
-		);
-		++arg->string;
-	} else {
-		ERROR_SYMBOL_ARGS(
-			arg,
-			"tail: Invalid arg type. Expected: %s or %s. Got: %s.",
-			value_type_names[QEXPRESSION_TYPE],
-			value_type_names[STRING_TYPE],
-			value_type_names[arg->type]
+			args,
+			count,
+			args[1]->number >= 0,
+			"memo: Capacity must be >= 0. Got %s.",
+			number
 		);
+		capacity = (size_t)args[1]->number;
 	}
-
-	return arg;
+	memo = memo_alloc(args[0], capacity);
+	if (count == 2)
+		value_free(args[1]);
+
+	/* Wrap lambda into function value with a cache */
+	rv = value_alloc(FUNCTION_TYPE);
+	rv->builtin = NULL;
+	rv->memo = memo;
+	rv->record_function = NULL;
+	return rv;
 }
 
 Value*
-value_symbol_while_eval(Value *value, Env *env)
+value_symbol_memo_stats_eval(Value **args, size_t count, Env *env)
 {
-	Value *condition_result,
-		*result;
+	(void)env;
 
-	VALIDATE_SYMBOL_ARGS_COUNT("while", value, 2);
-	VALIDATE_SYMBOL_ARG_TYPE("tail", value, 0, QEXPRESSION_TYPE);
-	VALIDATE_SYMBOL_ARG_TYPE("tail", value, 1, QEXPRESSION_TYPE);
+	Memo *memo;
+	Value *rv;
 
-	/* Set a default return value */
-	result = value_expression_alloc(SEXPRESSION_TYPE);
+	VALIDATE_SYMBOL_ARGS_COUNT("memo-stats", args, count, 1);
+	VALIDATE_SYMBOL_ARG_TYPE("memo-stats", args, count, 0, FUNCTION_TYPE);
+	VALIDATE_SYMBOL_ARGS(
+		args,
+		count,
+		args[0]->memo,
+		"memo-stats: Function is not memoized."
+	);
 
-	/* Convert children to sexpressions */
-	value->children[0]->type = SEXPRESSION_TYPE;
-	value->children[1]->type = SEXPRESSION_TYPE;
+	/* Collect {hits misses size capacity} */
+	memo = args[0]->memo;
+	rv = value_expression_alloc(QEXPRESSION_TYPE);
+	value_add_child(rv, value_number_alloc(memo->hits));
+	value_add_child(rv, value_number_alloc(memo->misses));
+	value_add_child(rv, value_number_alloc(memo->count));
+	value_add_child(rv, value_number_alloc(memo->capacity));
 
-	/* Loop */
-	while (1) {
-		condition_result = value_eval(value_copy(value->children[0]), env);
-		VALIDATE_SYMBOL_ARGS(
-			value,
-			condition_result->type == NUMBER_TYPE,
-			"while: Condition isn't a number, but %s.",
-			value_type_names[condition_result->type]
-		);
+	value_args_free(args, count);
+	return rv;
+}
 
-		if (condition_result->number)
-			result = value_eval(value_copy(value->children[1]), env);
-		else
-			break;
-	}
+Value*
+value_symbol_multiply_eval(Value **args, size_t count, Env *env)
+{
+	return value_symbol_arithmetic_eval("*", args, count, env);
+}
 
-	value_free(value);
-	return result;
+Value*
+value_symbol_ne_eval(Value **args, size_t count, Env *env)
+{
+	return value_symbol_cmp_eval("!=", args, count, env);
 }
 
-static unsigned char
-value_eq(const Value *x, const Value *y)
+Value*
+value_symbol_not_eval(Value **args, size_t count, Env *env)
 {
-	size_t i;
+	(void)env;
 
-	if (x->type != y->type)
-		return 0;
+	ValueNumber result;
 
-	switch (x->type) {
-	case ERROR_TYPE:
-		return strcmp(x->error, y->error) == 0;
-	case FUNCTION_TYPE:
-		if (x->builtin || y->builtin)
-			return x->builtin == y->builtin;
-		else
-			return value_eq(x->lambda_formals, y->lambda_formals)
-				&& value_eq(x->lambda_body, y->lambda_body);
-	case NUMBER_TYPE:
-		return x->number == y->number;
-	case QEXPRESSION_TYPE: /* FALLTHROUGH*/
-	case SEXPRESSION_TYPE:
-		if (x->children_count != y->children_count)\
-			return 0;
-		for (i = 0; i < x->children_count; ++i)
-			if (!value_eq(x->children[i], y->children[i]))
-				return 0;
-		return 1;
-	case STRING_TYPE:
-		return strcmp(x->string, y->string) == 0;
-	case SYMBOL_TYPE:
-		return strcmp(x->symbol, y->symbol) == 0;
-	}
-	return 0;
+	VALIDATE_SYMBOL_ARGS_COUNT("!", args, count, 1);
+	VALIDATE_SYMBOL_ARG_TYPE("!", args, count, 0, NUMBER_TYPE);
+
+	result = !args[0]->number;
+	value_args_free(args, count);
+	return value_number_alloc(result);
 }
 
-static void
-value_expression_print(const Value *value)
+/* Formats number as it's printed, but without quotes of string. */
+Value*
+value_symbol_number_to_string_eval(Value **args, size_t count, Env *env)
 {
-	size_t i;
+	(void)env;
 
-	if (value->type == SEXPRESSION_TYPE)
-		putchar('(');
-	else
-		putchar('{');
+	char buffer[NUMBER_BUFFER_SIZE];
 
-	/* Print children separated by space */
-	for (i = 0; i < value->children_count; ++i) {
-		value_print(value->children[i]);
-		if (i != value->children_count - 1)
-			putchar(' ');
-	}
+	VALIDATE_SYMBOL_ARGS_COUNT("number->string", args, count, 1);
+	VALIDATE_SYMBOL_ARG_TYPE("number->string", args, count, 0, NUMBER_TYPE);
 
-	if (value->type == SEXPRESSION_TYPE)
-		putchar(')');
-	else
-		putchar('}');
+	number_format(args[0]->number, buffer);
+	value_args_free(args, count);
+	return value_string_alloc(buffer);
 }
 
-/* Moves `from`'s children to `to` and frees `from`. */
-static void
-value_extend_children(Value *to, Value *from)
+Value*
+value_symbol_or_eval(Value **args, size_t count, Env *env)
 {
-	while (from->children_count > 0)
-		value_add_child(to, value_pop_child(from, 0));
-	value_free(from);
+	return value_symbol_condition_chain_eval("||", args, count, env);
 }
 
-/* Moves `from`'s string to `to` and frees `from`. */
-static void
-value_extend_string(Value *to, Value *from)
+/* Calls function with the rest of arguments packed to a single list. */
+Value*
+value_symbol_pack_eval(Value **args, size_t count, Env *env)
 {
-	size_t to_len = strlen(to->string);
-	to->string = realloc(to->string, to_len + strlen(from->string) + 1);
-	strcpy(to->string + to_len, from->string);
-
-	value_free(from);
-}
+	Value **list,
+		*result;
 
-/*
-Free entire value but not child `child_i`.
+	VALIDATE_SYMBOL_ARGS(
+		args,
+		count,
+		count >= 1,
+		"pack: Required at least one value."
+	);
+	VALIDATE_SYMBOL_ARG_TYPE("pack", args, count, 0, FUNCTION_TYPE);
 
-Returns child `child_i`.
-*/
-static Value*
-value_free_without_child(Value *value, size_t child_i)
-{
-	Value *child = value_pop_child(value, child_i);
-	value_free(value);
-	return child;
+	list = value_stack_push(1);
+	list[0] = value_symbol_list_eval(args + 1, count - 1, env);
+	result = value_function_call(args[0], env, list, 1);
+	value_stack_pop(1);
+	return result;
 }
 
-static Value*
-value_function_call(Value *f, Env *env, Value *args)
+Value*
+value_symbol_print_eval(Value **args, size_t count, Env *env)
 {
-	size_t args_given,
-		formals_expected;
-	Value *key,
-		*value;
+	(void)env;
 
-	/* Call builtin, if value isn't lambda */
-	if (f->builtin)
-		return f->builtin(args, env);
-
-	/* Arguments information */
-	formals_expected = f->lambda_formals->children_count;
-	args_given = args->children_count;
-
-	while (args->children_count > 0) {
-		/* Check that arguments count greater than formals count */
-		if (f->lambda_formals->children_count == 0) {
-			value_free(f);
-			value_free(args);
-			return value_error_alloc(
-				"Too many args. Expected %zu. Got %zu.",
-				formals_expected,
-				args_given
-			);
-		}
+	size_t i;
 
-		/* Pop formal */
-		key = value_pop_child(f->lambda_formals, 0);
+	/* Print args followed by a space */
+	for (i = 0; i < count; ++i) {
+		value_print(args[i]);
+		output_char(' ');
+	}
 
-		/* Bind all other arguments list to single formal after formal `&` */
-		if (strcmp(key->symbol, "&") == 0) {
-			/* Free `&` */
-			value_free(key);
+	/* Print newline, free args and return sexpression */
+	output_char('\n');
+	value_args_free(args, count);
+	return value_expression_alloc(SEXPRESSION_TYPE);
+}
 
-			/* Check that `&` followed by single formal */
-			if (f->lambda_formals->children_count != 1) {
-				value_free(f);
-				value_free(args);
-				return value_error_alloc("`&` not followed by single formal");
-			}
+/* Allocates persistent vector of arguments. */
+Value*
+value_symbol_pvec_eval(Value **args, size_t count, Env *env)
+{
+	(void)env;
 
-			/* Pop next formal and set remaining arguments list to it in env */
-			key = value_pop_child(f->lambda_formals, 0);
-			args->type = QEXPRESSION_TYPE;
-			env_set(f->env, key, args);
-			value_free(key);
-			break;
-		} else {
-			/* Bind argument to formal */
-			value = value_pop_child(args, 0);
-			env_set(f->env, key, value);
-			value_free(key);
-			value_free(value);
-		}
-	}
+	size_t i;
+	Value *rv = value_alloc(PVECTOR_TYPE);
 
-	/*
-	If no arguments remain, but formals remain and `&` is next in formals,
-	then bind followed formal to empty list
-	*/
-	if (
-		f->lambda_formals->children_count > 0
-		&& strcmp(f->lambda_formals->children[0]->symbol, "&") == 0
-	) {
-		/* Check that `&` followed by single formal */
-		if (f->lambda_formals->children_count != 2) {
-			value_free(f);
-			value_free(args);
-			return value_error_alloc("`&` not followed by single formal");
-		}
+	rv->pvector = pvector_alloc();
+	for (i = 0; i < count; ++i)
+		rv->pvector = pvector_conj(rv->pvector, args[i]);
+	return rv;
+}
 
-		/* Free `&` */
-		value_free(value_pop_child(f->lambda_formals, 0));
+/* Returns new version with item replaced or appended at index of length. */
+Value*
+value_symbol_pvec_assoc_eval(Value **args, size_t count, Env *env)
+{
+	(void)env;
 
-		/* Followed formal and it's value */
-		key = value_pop_child(f->lambda_formals, 0);
-		value = value_expression_alloc(QEXPRESSION_TYPE);
+	size_t index;
+	Value *rv;
 
-		/* Set and free */
-		env_set(f->env, key, value);
-		value_free(key);
-		value_free(value);
-	}
+	VALIDATE_SYMBOL_ARGS_COUNT("pvec-assoc", args, count, 3);
+	VALIDATE_SYMBOL_ARG_TYPE("pvec-assoc", args, count, 0, PVECTOR_TYPE);
+	VALIDATE_SYMBOL_ARG_TYPE("pvec-assoc", args, count, 1, NUMBER_TYPE);
+	VALIDATE_SYMBOL_ARGS(
+		args,
+		count,
+		value_number_integer(args[1]),
+		"pvec-assoc: Index must be an integer."
+	);
+	VALIDATE_SYMBOL_ARGS(
+		args,
+		count,
+		value_index_valid(args[1], args[0]->pvector->count + 1),
+		"pvec-assoc: Index out of range."
+	);
 
-	if (f->lambda_formals->children_count == 0) {
-		/* Eval function body as sexpression with parent env */
-		f->env->parent = env;
-		f->lambda_body->type = SEXPRESSION_TYPE;
-		value = value_eval(value_copy(f->lambda_body), f->env);
+	rv = args[0];
+	index = (size_t)args[1]->number;
+	if (index == rv->pvector->count)
+		rv->pvector = pvector_conj(rv->pvector, args[2]);
+	else
+		rv->pvector = pvector_assoc(rv->pvector, index, args[2]);
+	value_free(args[1]);
+	return rv;
+}
 
-		/* Free arguments and lambda function and return a result */
-		value_free(args);
-		value_free(f);
-		return value;
-	}
+/*
+Returns new version of the first vector with items of the second appended.
+Tries of both vectors are shared but for nodes where they meet.
+*/
+Value*
+value_symbol_pvec_concat_eval(Value **args, size_t count, Env *env)
+{
+	(void)env;
 
-	/* Copy partial called function with remaining formals */
-	value_free(args);
-	return f;
+	VALIDATE_SYMBOL_ARGS_COUNT("pvec-concat", args, count, 2);
+	VALIDATE_SYMBOL_ARG_TYPE("pvec-concat", args, count, 0, PVECTOR_TYPE);
+	VALIDATE_SYMBOL_ARG_TYPE("pvec-concat", args, count, 1, PVECTOR_TYPE);
+
+	args[0]->pvector = pvector_concat(args[0]->pvector, args[1]->pvector);
+	value_free(args[1]);
+	return args[0];
 }
 
-static void
+/* Returns new version with value appended. */
+Value*
+value_symbol_pvec_conj_eval(Value **args, size_t count, Env *env)
+{
+	(void)env;
+
+	VALIDATE_SYMBOL_ARGS_COUNT("pvec-conj", args, count, 2);
+	VALIDATE_SYMBOL_ARG_TYPE("pvec-conj", args, count, 0, PVECTOR_TYPE);
+
+	args[0]->pvector = pvector_conj(args[0]->pvector, args[1]);
+	return args[0];
+}
+
+Value*
+value_symbol_pvec_len_eval(Value **args, size_t count, Env *env)
+{
+	(void)env;
+
+	Value *rv;
+
+	VALIDATE_SYMBOL_ARGS_COUNT("pvec-len", args, count, 1);
+	VALIDATE_SYMBOL_ARG_TYPE("pvec-len", args, count, 0, PVECTOR_TYPE);
+
+	rv = value_number_alloc(args[0]->pvector->count);
+	value_args_free(args, count);
+	return rv;
+}
+
+Value*
+value_symbol_pvec_nth_eval(Value **args, size_t count, Env *env)
+{
+	(void)env;
+
+	Value *rv;
+
+	VALIDATE_SYMBOL_ARGS_COUNT("pvec-nth", args, count, 2);
+	VALIDATE_SYMBOL_ARG_TYPE("pvec-nth", args, count, 0, PVECTOR_TYPE);
+	VALIDATE_SYMBOL_ARG_TYPE("pvec-nth", args, count, 1, NUMBER_TYPE);
+	VALIDATE_SYMBOL_ARGS(
+		args,
+		count,
+		value_number_integer(args[1]),
+		"pvec-nth: Index must be an integer."
+	);
+	VALIDATE_SYMBOL_ARGS(
+		args,
+		count,
+		value_index_valid(args[1], args[0]->pvector->count),
+		"pvec-nth: Index out of range."
+	);
+
+	rv = value_copy(pvector_nth(args[0]->pvector, (size_t)args[1]->number));
+	value_args_free(args, count);
+	return rv;
+}
+
+Value*
+value_symbol_select_eval(Value **args, size_t count, Env *env)
+{
+	size_t i;
+	Value *result = NULL;
+
+	for (i = 0; i < count && !result; ++i)
+		result = value_select_clause(args[i], i, env);
+
+	value_args_free(args, count);
+	return result ? result : value_error_alloc("No selection found.");
+}
+
+Value*
+value_symbol_set_eval(Value **args, size_t count, Env *env)
+{
+	return value_symbol_variable_eval("=", args, count, env);
+}
+
+Value*
+value_symbol_substract_eval(Value **args, size_t count, Env *env)
+{
+	return value_symbol_arithmetic_eval("-", args, count, env);
+}
+
+Value*
+value_symbol_tail_eval(Value **args, size_t count, Env *env)
+{
+	(void)env;
+
+	Value *arg;
+
+	VALIDATE_SYMBOL_ARGS_COUNT("tail", args, count, 1);
+
+	arg = args[0];
+	if (arg->type == QEXPRESSION_TYPE) {
+		VALIDATE_SYMBOL_ARGS(
+			args,
+			count,
+			arg->children_count != 0,
+			"tail: Argument is empty."
+		);
+		arg = value_own(arg);
+		value_free(value_pop_child(arg, 0));
+	} else if (arg->type == STRING_TYPE) {
+		VALIDATE_SYMBOL_ARGS(
+			args,
+			count,
+			strlen(arg->string) != 0,
+			"tail: Argument is empty."
+		);
+
+		/* Shift chars with '\0' to keep allocated pointer */
+		arg = value_own(arg);
+		memmove(arg->string, arg->string + 1, strlen(arg->string));
+		arg->hashed = 0;
+	} else {
+		ERROR_SYMBOL_ARGS(
+			args,
+			count,
+			"tail: Invalid arg type. Expected: %s or %s. Got: %s.",
+			value_type_names[QEXPRESSION_TYPE],
+			value_type_names[STRING_TYPE],
+			value_type_names[arg->type]
+		);
+	}
+
+	return arg;
+}
+
+/*
+Calls function with elements of list as arguments. Elements are evaluated
+like the call was written with them.
+*/
+Value*
+value_symbol_unpack_eval(Value **args, size_t count, Env *env)
+{
+	size_t i;
+	Value **unpacked,
+		*result;
+
+	VALIDATE_SYMBOL_ARGS_COUNT("unpack", args, count, 2);
+	VALIDATE_SYMBOL_ARG_TYPE("unpack", args, count, 0, FUNCTION_TYPE);
+	VALIDATE_SYMBOL_ARG_TYPE("unpack", args, count, 1, QEXPRESSION_TYPE);
+
+	count = args[1]->children_count;
+	unpacked = value_stack_push(count);
+	for (i = 0; i < count; ++i) {
+		unpacked[i] = value_eval(args[1]->children[i], env);
+		if (unpacked[i]->type == ERROR_TYPE) {
+			result = unpacked[i];
+			value_args_free(unpacked, i);
+			value_args_free(args, 2);
+			value_stack_pop(count);
+			return result;
+		}
+	}
+
+	value_free(args[1]);
+	result = value_function_call(args[0], env, unpacked, count);
+	value_stack_pop(count);
+	return result;
+}
+
+/* Allocates vector of arguments. */
+Value*
+value_symbol_vector_eval(Value **args, size_t count, Env *env)
+{
+	(void)env;
+
+	size_t i;
+	Value *rv = value_alloc(VECTOR_TYPE);
+
+	rv->vector = vector_alloc(count);
+	for (i = 0; i < count; ++i)
+		vector_push(rv->vector, args[i]);
+	return rv;
+}
+
+Value*
+value_symbol_vector_get_eval(Value **args, size_t count, Env *env)
+{
+	(void)env;
+
+	Value *rv;
+
+	VALIDATE_SYMBOL_ARGS_COUNT("vector-get", args, count, 2);
+	VALIDATE_SYMBOL_ARG_TYPE("vector-get", args, count, 0, VECTOR_TYPE);
+	VALIDATE_SYMBOL_ARG_TYPE("vector-get", args, count, 1, NUMBER_TYPE);
+	VALIDATE_SYMBOL_ARGS(
+		args,
+		count,
+		value_number_integer(args[1]),
+		"vector-get: Index must be an integer."
+	);
+	VALIDATE_SYMBOL_ARGS(
+		args,
+		count,
+		value_index_valid(args[1], args[0]->vector->count),
+		"vector-get: Index out of range."
+	);
+
+	rv = value_copy(args[0]->vector->items[(size_t)args[1]->number]);
+	value_args_free(args, count);
+	return rv;
+}
+
+Value*
+value_symbol_vector_len_eval(Value **args, size_t count, Env *env)
+{
+	(void)env;
+
+	Value *rv;
+
+	VALIDATE_SYMBOL_ARGS_COUNT("vector-len", args, count, 1);
+	VALIDATE_SYMBOL_ARG_TYPE("vector-len", args, count, 0, VECTOR_TYPE);
+
+	rv = value_number_alloc(args[0]->vector->count);
+	value_args_free(args, count);
+	return rv;
+}
+
+/* Appends value to vector in place. */
+Value*
+value_symbol_vector_push_eval(Value **args, size_t count, Env *env)
+{
+	(void)env;
+
+	VALIDATE_SYMBOL_ARGS_COUNT("vector-push!", args, count, 2);
+	VALIDATE_SYMBOL_ARG_TYPE("vector-push!", args, count, 0, VECTOR_TYPE);
+
+	vector_push(args[0]->vector, args[1]);
+	value_vector_escape(args[0]->vector, args[0]->vector->count - 1);
+	value_free(args[0]);
+	return value_expression_alloc(SEXPRESSION_TYPE);
+}
+
+/* Replaces item of vector in place. */
+Value*
+value_symbol_vector_set_eval(Value **args, size_t count, Env *env)
+{
+	(void)env;
+
+	VALIDATE_SYMBOL_ARGS_COUNT("vector-set!", args, count, 3);
+	VALIDATE_SYMBOL_ARG_TYPE("vector-set!", args, count, 0, VECTOR_TYPE);
+	VALIDATE_SYMBOL_ARG_TYPE("vector-set!", args, count, 1, NUMBER_TYPE);
+	VALIDATE_SYMBOL_ARGS(
+		args,
+		count,
+		value_number_integer(args[1]),
+		"vector-set!: Index must be an integer."
+	);
+	VALIDATE_SYMBOL_ARGS(
+		args,
+		count,
+		value_index_valid(args[1], args[0]->vector->count),
+		"vector-set!: Index out of range."
+	);
+
+	vector_set(args[0]->vector, (size_t)args[1]->number, args[2]);
+	value_vector_escape(args[0]->vector, (size_t)args[1]->number);
+	value_free(args[0]);
+	value_free(args[1]);
+	return value_expression_alloc(SEXPRESSION_TYPE);
+}
+
+Value*
+value_symbol_while_eval(Value **args, size_t count, Env *env)
+{
+	Value *result;
+
+	VALIDATE_SYMBOL_ARGS_COUNT("while", args, count, 2);
+	VALIDATE_SYMBOL_ARG_TYPE("while", args, count, 0, QEXPRESSION_TYPE);
+	VALIDATE_SYMBOL_ARG_TYPE("while", args, count, 1, QEXPRESSION_TYPE);
+
+	result = value_while_loop(args[0], args[1], env);
+	value_args_free(args, count);
+	return result;
+}
+
+/* Allocates value of `type` without optimization guard. */
+static Value*
+value_alloc(ValueType type)
+{
+	Value *value = pool_alloc(sizeof(Value));
+	value->type = type;
+	value->refs = 0;
+	value->promoted = 0;
+	value->origin = NULL;
+	value->hashed = 0;
+	return value;
+}
+
+/* Frees `count` arguments, but not the stack they are stored in. */
+static void
+value_args_free(Value **args, size_t count)
+{
+	size_t i;
+	for (i = 0; i < count; ++i)
+		value_free(args[i]);
+}
+
+/*
+Returns value of `case` clause `clause` at argument `index` if its key equals
+`x`. Returns NULL if it doesn't.
+*/
+static Value*
+value_case_clause(const Value *x, const Value *clause, size_t index, Env *env)
+{
+	unsigned char matched;
+	Value *key = value_clause_check("case", clause, index);
+
+	if (key)
+		return key;
+	key = value_eval(clause->children[0], env);
+	if (key->type == ERROR_TYPE)
+		return key;
+
+	matched = value_eq(x, key);
+	value_free(key);
+	return matched ? value_eval(clause->children[1], env) : NULL;
+}
+
+/* Returns index of clause of `case` call `value` with key `x` or zero. */
+static size_t
+value_case_lookup(const Value *value, const Value *x)
+{
+	const ValueSite *site = value->site;
+	size_t i = value_hash(x) & (site->cases_size - 1);
+
+	for (; site->cases[i]; i = (i + 1) & (site->cases_size - 1))
+		if (value_eq(value->children[site->cases[i]]->children[0], x))
+			return site->cases[i];
+	return 0;
+}
+
+/*
+Allocates site of `case` call `value` with table of its clauses. Returns NULL
+if some key isn't a number or a string, then clauses are tried in order.
+*/
+static ValueSite*
+value_case_site_alloc(const Value *value)
+{
+	size_t i,
+		j,
+		size = 1;
+	const Value *clause;
+	ValueSite *site;
+
+	for (i = 2; i < value->children_count; ++i) {
+		clause = value->children[i];
+		if (
+			clause->type != QEXPRESSION_TYPE
+			|| clause->children_count < 2
+			|| (
+				clause->children[0]->type != NUMBER_TYPE
+				&& clause->children[0]->type != STRING_TYPE
+			)
+		)
+			return NULL;
+	}
+
+	/* Keep load factor under a half */
+	while (size < 2 * (value->children_count - 2))
+		size *= 2;
+
+	site = pool_alloc(sizeof(ValueSite));
+	site->refs = 1;
+	site->state = VALUE_SITE_GENERIC;
+	site->deopts = 0;
+	site->cases = calloc(size, sizeof(size_t));
+	site->cases_size = size;
+
+	/* The first of clauses with equal keys is matched */
+	for (i = 2; i < value->children_count; ++i) {
+		clause = value->children[i];
+		j = value_hash(clause->children[0]) & (size - 1);
+		while (
+			site->cases[j]
+			&& !value_eq(
+				value->children[site->cases[j]]->children[0],
+				clause->children[0]
+			)
+		)
+			j = (j + 1) & (size - 1);
+		if (!site->cases[j])
+			site->cases[j] = i;
+	}
+	return site;
+}
+
+/* Checks that argument `index` of `symbol` is a clause of two values. */
+static Value*
+value_clause_check(const char *symbol, const Value *clause, size_t index)
+{
+	if (clause->type != QEXPRESSION_TYPE)
+		return value_error_alloc(
+			"%s: Invalid %zu argument type. Expected %s. Got %s.",
+			symbol,
+			index,
+			value_type_names[QEXPRESSION_TYPE],
+			value_type_names[clause->type]
+		);
+	if (clause->children_count < 2)
+		return value_error_alloc(
+			"%s: %zu argument is not a clause of two values.",
+			symbol,
+			index
+		);
+	return NULL;
+}
+
+/*
+Shares cached hash of expression or string `from` with its copy `to`. Large
+value is hashed once, so all its copies reject unequal values at once.
+*/
+static void
+value_copy_hash(Value *to, const Value *from)
+{
+	if (!from->hashed && value_hash_large(from))
+		value_hash(from);
+	if (from->hashed) {
+		to->hash = from->hash;
+		to->hashed = 1;
+	}
+}
+
+/*
+Copies `value` without children of expression. Children are copied later by
+the pushed task.
+*/
+static Value*
+value_copy_node(const Value *value)
+{
+	Value *new_value;
+
+	/* Share hash-consed value */
+	if (value->refs) {
+		++((Value *)value)->refs;
+		return (Value *)value;
+	}
+
+	/* Alocate new value and set type to it */
+	new_value = value_alloc(value->type);
+
+	/* Copy guarded optimization */
+	if (value->origin) {
+		new_value->origin = value_copy(value->origin);
+		new_value->guard = value->guard;
+		new_value->guard_version = value->guard_version;
+	}
+
+	switch (value->type) {
+	case ERROR_TYPE:
+		/* Copy error message */
+		new_value->error = pool_strdup(value->error);
+		break;
+	case FUNCTION_TYPE:
+		new_value->memo = NULL;
+		new_value->record_function = NULL;
+		if (value->memo) {
+			/* Share cache of memoized function */
+			new_value->memo = memo_copy(value->memo);
+			new_value->builtin = NULL;
+		} else if (value->record_function) {
+			/* Share function declared by `defrecord` */
+			new_value->record_function = record_function_copy(
+				value->record_function
+			);
+			new_value->builtin = NULL;
+		} else if (value->builtin) {
+			/* Copy builtin's pointer */
+			new_value->builtin = value->builtin;
+		} else {
+			/*
+			Share lambda's code and captured env and copy its partially
+			applied arguments
+			*/
+			new_value->env = env_copy(value->env);
+			new_value->lambda = value->lambda;
+			++value->lambda->refs;
+			new_value->lambda_args = value->lambda_args
+				? value_copy(value->lambda_args)
+				: NULL;
+			new_value->builtin = NULL;
+		}
+		break;
+	case NUMBER_TYPE:
+		new_value->number = value->number;
+		break;
+	case SEXPRESSION_TYPE: /* FALLTHROUGH */
+	case QEXPRESSION_TYPE:
+		value_copy_hash(new_value, value);
+
+		/* Share feedback of call site */
+		new_value->site = value->site;
+		if (value->site)
+			++value->site->refs;
+
+		/* Children are copied by the caller */
+		new_value->children_count = value->children_count;
+		new_value->children = malloc(sizeof(Value *) * value->children_count);
+		if (value->children_count > 0)
+			value_tasks_push(value)->target = new_value;
+		break;
+	case STRING_TYPE:
+		value_copy_hash(new_value, value);
+
+		/* Copy string */
+		new_value->string = pool_strdup(value->string);
+		break;
+	case SYMBOL_TYPE:
+		/* Copy symbol and its global slot */
+		new_value->symbol = pool_strdup(value->symbol);
+		new_value->slot = value->slot;
+		new_value->builtin = value->builtin;
+		break;
+	case VECTOR_TYPE:
+		/* Share items */
+		new_value->vector = vector_copy(value->vector);
+		break;
+	case PVECTOR_TYPE:
+		/* Share immutable trie */
+		new_value->pvector = pvector_copy(value->pvector);
+		break;
+	case MAP_TYPE:
+		/* Share immutable trie */
+		new_value->map = hamt_copy(value->map);
+		break;
+	case RECORD_TYPE:
+		/* Share immutable fields */
+		new_value->record = record_copy(value->record);
+		break;
+	}
+
+	return new_value;
+}
+
+/* Checks that vectors `x` and `y` are compared by a task on the stack. */
+static unsigned char
+value_eq_comparing(const Value *x, const Value *y)
+{
+	size_t i;
+	const ValueTask *task;
+
+	for (i = 0; i < value_tasks.count; ++i) {
+		task = &value_tasks.items[i];
+		if (
+			task->value
+			&& task->value->type == VECTOR_TYPE
+			&& task->other
+			&& task->value->vector == x->vector
+			&& task->other->vector == y->vector
+		)
+			return 1;
+	}
+	return 0;
+}
+
+/*
+Compares `x` and `y` without their items. Items of expressions and containers
+of equal length are compared later by the pushed task.
+*/
+static unsigned char
+value_eq_node(const Value *x, const Value *y)
+{
+	ValueMapEq map_eq;
+	ValueTask *task;
+
+	if (x->type != y->type)
+		return 0;
+	else if (x->refs && x == y)
+		return 1;
+	else if (x->hashed && y->hashed && x->hash != y->hash)
+		return 0;
+
+	switch (x->type) {
+	case ERROR_TYPE:
+		return strcmp(x->error, y->error) == 0;
+	case FUNCTION_TYPE:
+		if (x->memo || y->memo)
+			return x->memo == y->memo;
+		else if (x->record_function || y->record_function)
+			return x->record_function == y->record_function;
+		else if (x->builtin || y->builtin)
+			return x->builtin == y->builtin;
+		else if (!x->lambda_args != !y->lambda_args)
+			return 0;
+		else if (x->lambda_args && !value_eq(x->lambda_args, y->lambda_args))
+			return 0;
+		else if (x->env != y->env)
+			return 0;
+		return x->lambda == y->lambda || (
+			value_eq(x->lambda->formals, y->lambda->formals)
+			&& value_eq(x->lambda->body, y->lambda->body)
+		);
+	case NUMBER_TYPE:
+		return x->number == y->number;
+	case QEXPRESSION_TYPE: /* FALLTHROUGH*/
+	case SEXPRESSION_TYPE:
+		if (x->children_count != y->children_count)
+			return 0;
+		else if (x->children_count > 0)
+			value_tasks_push(x)->other = y;
+		return 1;
+	case STRING_TYPE:
+		return strcmp(x->string, y->string) == 0;
+	case SYMBOL_TYPE:
+		return strcmp(x->symbol, y->symbol) == 0;
+	case VECTOR_TYPE:
+		if (x->vector == y->vector)
+			return 1;
+		else if (x->vector->count != y->vector->count)
+			return 0;
+
+		/* Pair reached again through a cycle is equal if the rest is */
+		if (x->vector->comparing && value_eq_comparing(x, y))
+			return 1;
+		++x->vector->comparing;
+		value_tasks_push(x)->other = y;
+		return 1;
+	case PVECTOR_TYPE:
+		if (x->pvector == y->pvector)
+			return 1;
+		else if (x->pvector->count != y->pvector->count)
+			return 0;
+		value_tasks_push(x)->other = y;
+		return 1;
+	case MAP_TYPE:
+		if (x->map == y->map)
+			return 1;
+		else if (x->map->count != y->map->count)
+			return 0;
+
+		/* Values are compared in order of entries of `x` */
+		map_eq.other = y->map;
+		map_eq.eq = 1;
+		map_eq.values = value_items_alloc(x->map->count);
+		map_eq.other_values = value_items_alloc(x->map->count);
+		hamt_each(x->map, value_map_eq_visit, &map_eq);
+		if (!map_eq.eq) {
+			value_items_free(map_eq.values);
+			value_items_free(map_eq.other_values);
+			return 0;
+		}
+		task = value_tasks_push(x);
+		task->target = map_eq.values;
+		task->other = map_eq.other_values;
+		return 1;
+	case RECORD_TYPE:
+		if (x->record == y->record)
+			return 1;
+		else if (x->record->type != y->record->type)
+			return 0;
+		value_tasks_push(x)->other = y;
+		return 1;
+	}
+	return 0;
+}
+
+/* Pops task of compared values. */
+static void
+value_eq_pop(void)
+{
+	const ValueTask *task = &value_tasks.items[value_tasks.count - 1];
+
+	if (task->value->type == VECTOR_TYPE)
+		--task->value->vector->comparing;
+	value_tasks_pop();
+}
+
+/* Prints opening bracket, children are printed by the pushed task. */
+static void
+value_expression_print(const Value *value)
+{
+	if (value->type == SEXPRESSION_TYPE)
+		output_char('(');
+	else
+		output_char('{');
+	value_tasks_push(value);
+}
+
+/* Reserves empty record of escape from arena. */
+static ValueEscape*
+value_escapes_push(void)
+{
+	ValueEscape *escape;
+
+	if (value_escapes.count == value_escapes.capacity) {
+		value_escapes.capacity = value_escapes.capacity
+			? value_escapes.capacity * 2
+			: VALUE_ESCAPES_MIN_CAPACITY;
+		value_escapes.items = realloc(
+			value_escapes.items,
+			sizeof(ValueEscape) * value_escapes.capacity
+		);
+	}
+	escape = &value_escapes.items[value_escapes.count++];
+	escape->entry = NULL;
+	escape->vector = NULL;
+	escape->memo = NULL;
+	return escape;
+}
+
+/* Moves `from`'s children to `to` and frees `from`. */
+static void
+value_extend_children(Value *to, Value *from)
+{
+	from = value_own(from);
+	to->children = realloc(
+		to->children,
+		sizeof(Value *) * (to->children_count + from->children_count)
+	);
+	memcpy(
+		to->children + to->children_count,
+		from->children,
+		sizeof(Value *) * from->children_count
+	);
+	to->children_count += from->children_count;
+	to->hashed = 0;
+	from->children_count = 0;
+	value_free(from);
+}
+
+/* Moves `from`'s string to `to` and frees `from`. */
+static void
+value_extend_string(Value *to, Value *from)
+{
+	to->string = pool_strcat(to->string, from->string);
+	to->hashed = 0;
+	value_free(from);
+}
+
+/*
+Returns qexpression argument `index` of special form call `value` to evaluate
+it as code. Literal qexpression is borrowed from the call, other argument is
+evaluated and returned through `owned`, which caller frees.
+*/
+static const Value*
+value_form_code(const Value *value, size_t index, Env *env, Value **owned)
+{
+	if (value->children[index]->type == QEXPRESSION_TYPE) {
+		*owned = NULL;
+		return value->children[index];
+	}
+	*owned = value_eval(value->children[index], env);
+	return *owned;
+}
+
+/*
+Evaluates `case` call `value` without copying its clauses. Constant keys are
+looked up in the table of call site.
+*/
+static Value*
+value_form_case(const Value *value, Env *env)
+{
+	size_t i;
+	const Value *clause;
+	Value *x,
+		*owned,
+		*result = NULL;
+
+	x = value_eval(value->children[1], env);
+	if (x->type == ERROR_TYPE)
+		return x;
+
+	if (value->site && value->site->cases) {
+		i = value_case_lookup(value, x);
+		if (i)
+			result = value_eval(value->children[i]->children[1], env);
+	} else {
+		for (i = 2; i < value->children_count && !result; ++i) {
+			clause = value_form_code(value, i, env, &owned);
+			if (clause->type == ERROR_TYPE) {
+				value_free(x);
+				return owned;
+			}
+			result = value_case_clause(x, clause, i - 1, env);
+			if (owned)
+				value_free(owned);
+		}
+	}
+
+	value_free(x);
+	return result ? result : value_error_alloc("No case found.");
+}
+
+/*
+Evaluates `&&` call `value` or `||` one if `or` is set. Arguments are
+evaluated from left to right only until the result is known.
+*/
+static Value*
+value_form_condition_chain(const Value *value, Env *env, unsigned char or)
+{
+	size_t i;
+	unsigned char decisive;
+	const char *symbol = or ? "||" : "&&";
+	Value *operand,
+		*result;
+
+	if (value->children_count < 3)
+		return value_error_alloc(
+			"%s: Too few arguments. Expected greater or equal to 2. Got %zu.",
+			symbol,
+			value->children_count - 1
+		);
+
+	for (i = 1; i < value->children_count; ++i) {
+		operand = value_eval(value->children[i], env);
+		if (operand->type == ERROR_TYPE)
+			return operand;
+		if (operand->type != NUMBER_TYPE) {
+			result = value_error_alloc(
+				"%s: Invalid %zu argument type. Expected %s. Got %s.",
+				symbol,
+				i - 1,
+				value_type_names[NUMBER_TYPE],
+				value_type_names[operand->type]
+			);
+			value_free(operand);
+			return result;
+		}
+
+		/* True operand decides `||`, false one decides `&&` */
+		decisive = or ? operand->number != 0 : operand->number == 0;
+		value_free(operand);
+		if (decisive)
+			return value_number_alloc(or);
+	}
+	return value_number_alloc(!or);
+}
+
+/*
+Evaluates `for` call `value`, or `dotimes` one if `times` is set, without
+copying its body.
+*/
+static Value*
+value_form_for(const Value *value, Env *env, unsigned char times)
+{
+	size_t i,
+		count = times ? 3 : 4;
+	const Value *code[4];
+	Value *owned[4] = {NULL, NULL, NULL, NULL},
+		*result = NULL;
+
+	if (value->children_count != count + 1)
+		return value_error_alloc(
+			"%s: Too many arguments. Expected %zu. Got %zu.",
+			times ? "dotimes" : "for",
+			count,
+			value->children_count - 1
+		);
+
+	for (i = 0; i < count && !result; ++i) {
+		code[i] = value_form_code(value, i + 1, env, &owned[i]);
+		if (code[i]->type == ERROR_TYPE) {
+			result = owned[i];
+			owned[i] = NULL;
+		}
+	}
+
+	if (!result)
+		result = value_for_loop(code, env, times);
+
+	for (i = 0; i < count; ++i)
+		if (owned[i])
+			value_free(owned[i]);
+	return result;
+}
+
+/* Evaluates `if` call `value` without copying its branches. */
+static Value*
+value_form_if(const Value *value, Env *env)
+{
+	size_t index;
+	const Value *branch;
+	Value *condition,
+		*owned,
+		*result;
+
+	if (value->children_count != 4)
+		return value_error_alloc(
+			"if: Too many arguments. Expected %zu. Got %zu.",
+			(size_t)3,
+			value->children_count - 1
+		);
+
+	condition = value_eval(value->children[1], env);
+	if (condition->type == ERROR_TYPE)
+		return condition;
+	if (condition->type != NUMBER_TYPE) {
+		result = value_error_alloc(
+			"if: Invalid %zu argument type. Expected %s. Got %s.",
+			(size_t)0,
+			value_type_names[NUMBER_TYPE],
+			value_type_names[condition->type]
+		);
+		value_free(condition);
+		return result;
+	}
+
+	/* Only the chosen branch is evaluated */
+	index = condition->number ? 2 : 3;
+	value_free(condition);
+	branch = value_form_code(value, index, env, &owned);
+	if (branch->type == ERROR_TYPE)
+		return owned;
+	if (branch->type != QEXPRESSION_TYPE) {
+		result = value_error_alloc(
+			"if: Invalid %zu argument type. Expected %s. Got %s.",
+			index - 1,
+			value_type_names[QEXPRESSION_TYPE],
+			value_type_names[branch->type]
+		);
+		value_free(owned);
+		return result;
+	}
+
+	result = value_sexpression_eval(branch, env);
+	if (owned)
+		value_free(owned);
+	return result;
+}
+
+/* Evaluates `let` call `value` without copying its body. */
+static Value*
+value_form_let(const Value *value, Env *env)
+{
+	const Value *body;
+	Value *owned,
+		*result;
+
+	if (value->children_count != 2)
+		return value_error_alloc(
+			"let: Too many arguments. Expected %zu. Got %zu.",
+			(size_t)1,
+			value->children_count - 1
+		);
+
+	body = value_form_code(value, 1, env, &owned);
+	if (body->type == ERROR_TYPE)
+		return owned;
+	if (body->type != QEXPRESSION_TYPE) {
+		result = value_error_alloc(
+			"let: Invalid %zu argument type. Expected %s. Got %s.",
+			(size_t)0,
+			value_type_names[QEXPRESSION_TYPE],
+			value_type_names[body->type]
+		);
+		value_free(owned);
+		return result;
+	}
+
+	result = value_let_eval(body, env);
+	if (owned)
+		value_free(owned);
+	return result;
+}
+
+/* Evaluates `select` call `value` without copying its clauses. */
+static Value*
+value_form_select(const Value *value, Env *env)
+{
+	size_t i;
+	const Value *clause;
+	Value *owned,
+		*result = NULL;
+
+	for (i = 1; i < value->children_count && !result; ++i) {
+		clause = value_form_code(value, i, env, &owned);
+		if (clause->type == ERROR_TYPE)
+			return owned;
+		result = value_select_clause(clause, i - 1, env);
+		if (owned)
+			value_free(owned);
+	}
+	return result ? result : value_error_alloc("No selection found.");
+}
+
+/* Evaluates `while` call `value` without copying its condition and body. */
+static Value*
+value_form_while(const Value *value, Env *env)
+{
+	size_t i;
+	const Value *code[2];
+	Value *owned[2] = {NULL, NULL},
+		*result = NULL;
+
+	if (value->children_count != 3)
+		return value_error_alloc(
+			"while: Too many arguments. Expected %zu. Got %zu.",
+			(size_t)2,
+			value->children_count - 1
+		);
+
+	for (i = 0; i < 2 && !result; ++i) {
+		code[i] = value_form_code(value, i + 1, env, &owned[i]);
+		if (code[i]->type == ERROR_TYPE) {
+			result = owned[i];
+			owned[i] = NULL;
+		} else if (code[i]->type != QEXPRESSION_TYPE) {
+			result = value_error_alloc(
+				"while: Invalid %zu argument type. Expected %s. Got %s.",
+				i,
+				value_type_names[QEXPRESSION_TYPE],
+				value_type_names[code[i]->type]
+			);
+		}
+	}
+
+	if (!result)
+		result = value_while_loop(code[0], code[1], env);
+
+	for (i = 0; i < 2; ++i)
+		if (owned[i])
+			value_free(owned[i]);
+	return result;
+}
+
+/*
+Counts reference to frame `env` from a reached frame or closure, or marks
+`env` live if `live` is set. Only the returning frame and frames enclosed by it
+are tracked, references through others are taken as references from elsewhere.
+*/
+static void
+value_frame_reach(Env *env, unsigned char live)
+{
+	size_t i;
+	Env *ancestor;
+	ValueFrame *reached;
+
+	for (i = 0; i < value_frames.count; ++i)
+		if (value_frames.items[i].env == env)
+			break;
+
+	if (i == value_frames.count) {
+		/* The first one is the returning frame */
+		ancestor = env;
+		while (i > 0 && ancestor && ancestor != value_frames.items[0].env)
+			ancestor = ancestor->parent;
+		if (!ancestor)
+			return;
+
+		if (value_frames.count == value_frames.capacity) {
+			value_frames.capacity = value_frames.capacity
+				? value_frames.capacity * 2
+				: VALUE_FRAMES_MIN_CAPACITY;
+			value_frames.items = realloc(
+				value_frames.items,
+				sizeof(ValueFrame) * value_frames.capacity
+			);
+		}
+		reached = &value_frames.items[value_frames.count++];
+		reached->env = env;
+		reached->refs = 0;
+		reached->live = 0;
+		reached->scanned = 0;
+	}
+
+	reached = &value_frames.items[i];
+	if (live)
+		reached->live = 1;
+	else
+		++reached->refs;
+}
+
+/*
+Releases `frame` of a returning call. A closure bound in the frame, directly
+or through items and frames of nested calls, refers back to it, so the frame
+would be kept alive by the cycle. If references found from its bindings
+account for all other references of the frame, its bindings are freed, which
+breaks the cycle. Hash-consed values and shared containers aren't entered, so
+closures in them keep the frame.
+*/
+static void
+value_frame_release(Env *frame)
+{
+	size_t i;
+	unsigned char scanned;
+	ValueFrame *reached;
+
+	if (frame->refs == 1) {
+		env_release(frame);
+		return;
+	}
+
+	/* Count references of frames reached from bindings, the call holds one */
+	value_frames.count = 0;
+	value_frame_reach(frame, 0);
+	for (i = 0; i < value_frames.count; ++i)
+		value_frame_scan(value_frames.items[i].env, 0);
+
+	/* Frame referenced from elsewhere keeps frames it reaches alive */
+	for (i = 0; i < value_frames.count; ++i) {
+		reached = &value_frames.items[i];
+		reached->live = reached->refs < reached->env->refs;
+	}
+	do {
+		scanned = 0;
+		for (i = 0; i < value_frames.count; ++i) {
+			reached = &value_frames.items[i];
+			if (reached->live && !reached->scanned) {
+				reached->scanned = scanned = 1;
+				value_frame_scan(reached->env, 1);
+			}
+		}
+	} while (scanned && !value_frames.items[0].live);
+
+	if (!value_frames.items[0].live)
+		env_clear(frame);
+	env_release(frame);
+}
+
+/* Reaches parent of frame `env` and closures of its bindings. */
+static void
+value_frame_scan(Env *env, unsigned char live)
+{
+	size_t i;
+	EnvEntry *entry;
+
+	if (env->parent)
+		value_frame_reach(env->parent, live);
+	for (i = 0; i < env->count; ++i)
+		value_frame_scan_value(env->entries[i].value, live);
+	for (entry = env->extra; entry; entry = entry->next)
+		value_frame_scan_value(entry->value, live);
+}
+
+/*
+Reaches frames of closures in `value`, its items and fields of vectors and
+records it doesn't share. Items are visited by a loop.
+*/
+static void
+value_frame_scan_value(const Value *value, unsigned char live)
+{
+	size_t base = value_tasks.count;
+	ValueTask *task;
+
+	do {
+		if (value->refs) {
+			/* Hash-consed value has no closures */
+		} else if (
+			value->type == FUNCTION_TYPE
+			&& !value->builtin
+			&& !value->memo
+			&& !value->record_function
+		) {
+			value_frame_reach(value->env, live);
+			if (value->lambda_args)
+				value_tasks_push(value->lambda_args);
+		} else if (
+			value->type == SEXPRESSION_TYPE
+			|| value->type == QEXPRESSION_TYPE
+			|| (value->type == VECTOR_TYPE && value->vector->refs == 1)
+			|| (value->type == RECORD_TYPE && value->record->refs == 1)
+		) {
+			value_tasks_push(value);
+		}
+
+		/* Take the next item of the innermost unfinished value */
+		value = NULL;
+		while (!value && value_tasks.count > base) {
+			task = &value_tasks.items[value_tasks.count - 1];
+			if (task->index < value_items_count(task->value))
+				value = value_item(task->value, task->index++);
+			else
+				--value_tasks.count;
+		}
+	} while (value);
+}
+
+/*
+Frees `value` without children of expression. Expression with children is
+left to the pushed task.
+*/
+static void
+value_free_node(Value *value)
+{
+	/* Hash-consed value is freed with its last copy */
+	if (value->refs) {
+		if (--value->refs > 0)
+			return;
+		hashcons_remove(value);
+	}
+
+	if (value->origin)
+		value_free(value->origin);
+
+	if (value->type == SEXPRESSION_TYPE || value->type == QEXPRESSION_TYPE) {
+		if (value->site && --value->site->refs == 0) {
+			free(value->site->cases);
+			pool_free(value->site, sizeof(ValueSite));
+		}
+
+		/* Children and the expression are freed by the caller */
+		if (value->children_count > 0) {
+			value_tasks_push(value)->target = value;
+			return;
+		}
+		free(value->children);
+	} else if (value->type == ERROR_TYPE) {
+		/* Free allocated error message */
+		pool_strfree(value->error);
+	} else if (value->type == FUNCTION_TYPE && value->memo) {
+		/* Release shared cache */
+		memo_free(value->memo);
+	} else if (value->type == FUNCTION_TYPE && value->record_function) {
+		/* Release shared function of record type */
+		record_function_free(value->record_function);
+	} else if (value->type == FUNCTION_TYPE && !value->builtin) {
+		/* Release captured env and shared code of lambda */
+		env_release(value->env);
+		if (--value->lambda->refs == 0) {
+			value_free(value->lambda->formals);
+			value_free(value->lambda->body);
+			pool_free(value->lambda, sizeof(ValueLambda));
+		}
+		if (value->lambda_args)
+			value_free(value->lambda_args);
+	} else if (value->type == STRING_TYPE) {
+		/* Free allocated string */
+		pool_strfree(value->string);
+	} else if (value->type == SYMBOL_TYPE) {
+		/* Free allocated symbol */
+		pool_strfree(value->symbol);
+	} else if (value->type == VECTOR_TYPE) {
+		/* Release shared items */
+		vector_free(value->vector);
+	} else if (value->type == PVECTOR_TYPE) {
+		/* Release shared trie */
+		pvector_free(value->pvector);
+	} else if (value->type == MAP_TYPE) {
+		/* Release shared trie */
+		hamt_free(value->map);
+	} else if (value->type == RECORD_TYPE) {
+		/* Release shared fields */
+		record_free(value->record);
+	}
+	pool_free(value, sizeof(Value));
+}
+
+/*
+Free entire value but not child `child_i`.
+
+Returns child `child_i`.
+*/
+static Value*
+value_free_without_child(Value *value, size_t child_i)
+{
+	Value *child = value_pop_child(value, child_i);
+	value_free(value);
+	return child;
+}
+
+/* Calls function `f` with `count` arguments `args` from `env`. */
+static Value*
+value_function_call(Value *f, Env *env, Value **args, size_t count)
+{
+	size_t bound;
+	Value **all,
+		*value;
+
+	/* Call builtin, if value isn't lambda */
+	if (f->builtin) {
+		value = f->builtin(args, count, env);
+		value_free(f);
+		return value;
+	} else if (f->memo) {
+		return value_memo_call(f, env, args, count);
+	} else if (f->record_function) {
+		value = value_record_call(f->record_function, args, count);
+		value_free(f);
+		return value;
+	} else if (!f->lambda_args) {
+		return value_lambda_call(f, args, count, count);
+	}
+
+	/* Prepend arguments of previous partial applications */
+	bound = f->lambda_args->children_count;
+	all = value_stack_push(bound + count);
+	memcpy(all, f->lambda_args->children, sizeof(Value *) * bound);
+	memcpy(all + bound, args, sizeof(Value *) * count);
+	f->lambda_args->children_count = 0;
+	value_free(f->lambda_args);
+	f->lambda_args = NULL;
+
+	value = value_lambda_call(f, all, bound + count, count);
+	value_stack_pop(bound + count);
+	return value;
+}
+
+/*
+Moves `count` arguments `args` to formals of lambda `f` in a new frame
+enclosed by lambda's captured env and evaluates its body. The last `given`
+arguments are given by this call. If arguments are over, returns partially
+applied lambda, which keeps them for the next call.
+*/
+static Value*
+value_lambda_call(Value *f, Value **args, size_t count, size_t given)
+{
+	size_t i;
+	const ValueLambda *lambda = f->lambda;
+	const Value *formals = lambda->formals;
+	Env *frame;
+	Value *rest,
+		*value;
+
+	/* Return partially applied function if arguments are over */
+	if (count < lambda->required) {
+		f->lambda_args = value_expression_alloc(QEXPRESSION_TYPE);
+		f->lambda_args->children = malloc(sizeof(Value *) * count);
+		memcpy(f->lambda_args->children, args, sizeof(Value *) * count);
+		f->lambda_args->children_count = count;
+		return f;
+	}
+
+	/* Check that `&` followed by single formal */
+	if (lambda->variadic && formals->children_count != lambda->required + 2) {
+		value_free(f);
+		value_args_free(args, count);
+		return value_error_alloc("`&` not followed by single formal");
+	}
+
+	/* Check that arguments count greater than formals count */
+	if (!lambda->variadic && count > lambda->required) {
+		value_free(f);
+		value_args_free(args, count);
+		return value_error_alloc(
+			"Too many args. Expected %zu. Got %zu.",
+			formals->children_count - (count - given),
+			given
+		);
+	}
+
+	/* Frame is sized by formals, so binding does not allocate */
+	frame = env_alloc(lambda->required + lambda->variadic);
+	frame->parent = env_copy(f->env);
+	for (i = 0; i < lambda->required; ++i)
+		env_put(frame, formals->children[i], args[i]);
+
+	/* Move remaining arguments to list after `&`, it's empty if there are no ones */
+	if (lambda->variadic) {
+		rest = value_expression_alloc(QEXPRESSION_TYPE);
+		if (count > i) {
+			rest->children_count = count - i;
+			rest->children = malloc(sizeof(Value *) * rest->children_count);
+			memcpy(rest->children, args + i, sizeof(Value *) * (count - i));
+		}
+		env_put(frame, formals->children[i + 1], rest);
+	}
+
+	/* Eval function body as sexpression */
+	value = value_sexpression_eval(lambda->body, frame);
+
+	/* Free frame with arguments and lambda function and return a result */
+	value_frame_release(frame);
+	value_free(f);
+	return value;
+}
+
+static void
 value_function_print(const Value *value)
 {
-	if (value->builtin) {
-		printf("<builtin>");
+	size_t i;
+	const Value *formals;
+
+	if (value->memo) {
+		output_string("<memo ");
+		value_print(value->memo->function);
+		output_char('>');
+	} else if (value->record_function) {
+		output_format("<%s>", value->record_function->name);
+	} else if (value->builtin) {
+		output_string("<builtin>");
 	} else {
-		printf("(\\ ");
-		value_print(value->lambda_formals);
-		putchar(' ');
-		value_print(value->lambda_body);
-		putchar(')');
+		/* Print formals remaining after partial application */
+		output_string("(\\ {");
+		formals = value->lambda->formals;
+		i = value->lambda_args ? value->lambda_args->children_count : 0;
+		for (; i < formals->children_count; ++i) {
+			value_print(formals->children[i]);
+			if (i != formals->children_count - 1)
+				output_char(' ');
+		}
+		output_string("} ");
+		value_print(value->lambda->body);
+		output_char(')');
+	}
+}
+
+/* Checks that globals optimized `value` depends on were not redefined. */
+static unsigned char
+value_guard_valid(const Value *value)
+{
+	size_t i;
+	const Value *child;
+
+	if (value->guard->version != value->guard_version)
+		return 0;
+
+	/*
+	Folded constant also depends on guards of folded arguments, which are
+	never evaluated
+	*/
+	if (value->type != SEXPRESSION_TYPE) {
+		for (i = 0; i < value->origin->children_count; ++i) {
+			child = value->origin->children[i];
+			if (child->origin && !value_guard_valid(child))
+				return 0;
+		}
+	}
+	return 1;
+}
+
+/* Checks that expression or string `value` is worth caching its hash. */
+static unsigned char
+value_hash_large(const Value *value)
+{
+	size_t i = 0;
+
+	if (value->type == SEXPRESSION_TYPE || value->type == QEXPRESSION_TYPE)
+		return value->children_count >= VALUE_HASH_MIN_SIZE;
+	else if (value->type != STRING_TYPE)
+		return 0;
+
+	while (i < VALUE_HASH_MIN_SIZE && value->string[i] != '\0')
+		++i;
+	return i == VALUE_HASH_MIN_SIZE;
+}
+
+/*
+Hashes `value` without its items to `hash`. Returns 1 if the hash is finished,
+then `mutable` is set if `value` is a vector, or 0 if task of items is pushed
+instead.
+*/
+static unsigned char
+value_hash_node(const Value *value, size_t *hash, unsigned char *mutable)
+{
+	size_t i;
+	const char *ptr = NULL;
+	ValueNumber number;
+	unsigned char bytes[sizeof(ValueNumber)];
+	Value *cache = (Value *)value;
+	ValueTask *task;
+
+	*hash = (size_t)value->type + 1;
+	*mutable = value->type == VECTOR_TYPE;
+	if (value->hashed) {
+		*hash = value->hash;
+		return 1;
+	}
+
+	switch (value->type) {
+	case ERROR_TYPE:
+		ptr = value->error;
+		break;
+	case FUNCTION_TYPE:
+		if (value->memo) {
+			*hash = *hash * 31 + (size_t)value->memo;
+		} else if (value->record_function) {
+			*hash = *hash * 31 + (size_t)value->record_function;
+		} else if (value->builtin) {
+			*hash = *hash * 31 + (size_t)value->builtin;
+		} else {
+			*hash = *hash * 31 + value_hash(value->lambda->formals) * 17
+				+ value_hash(value->lambda->body) + (size_t)value->env;
+			if (value->lambda_args)
+				*hash = *hash * 31 + value_hash(value->lambda_args);
+		}
+		return 1;
+	case NUMBER_TYPE:
+		/* Zeros are equal independent of sign */
+		number = value->number == 0 ? 0 : value->number;
+		memcpy(bytes, &number, sizeof(ValueNumber));
+		for (i = 0; i < sizeof(ValueNumber); ++i)
+			*hash = bytes[i] + 31 * *hash;
+		return 1;
+	case QEXPRESSION_TYPE: /* FALLTHROUGH */
+	case SEXPRESSION_TYPE:
+		break;
+	case STRING_TYPE:
+		ptr = value->string;
+		break;
+	case SYMBOL_TYPE:
+		ptr = value->symbol;
+		break;
+	case VECTOR_TYPE:
+		/* Vector reached from its own items hashes by type only */
+		if (value->vector->visiting)
+			return 1;
+		value->vector->visiting = 1;
+		break;
+	case PVECTOR_TYPE: /* FALLTHROUGH */
+	case MAP_TYPE:
+		break;
+	case RECORD_TYPE:
+		*hash = *hash * 31 + (size_t)value->record->type;
+		break;
+	}
+
+	if (ptr) {
+		for (; *ptr != '\0'; ++ptr)
+			*hash = *ptr + 31 * *hash;
+		if (value->type == STRING_TYPE) {
+			cache->hash = *hash;
+			cache->hashed = 1;
+		}
+		return 1;
+	}
+
+	/* Items are hashed by the loop */
+	task = value_tasks_push(value);
+	task->hash = *hash;
+	task->mutable = *mutable;
+	if (value->type == MAP_TYPE)
+		task->target = value_map_flatten(value);
+	return 0;
+}
+
+/*
+Pops task of hashed value. Returns hash of the value and sets `mutable` if it
+reaches a vector.
+*/
+static size_t
+value_hash_pop(unsigned char *mutable)
+{
+	ValueTask *task = &value_tasks.items[value_tasks.count - 1];
+	Value *cache = (Value *)task->value;
+	size_t hash = task->hash;
+
+	*mutable = task->mutable;
+	if (cache->type == VECTOR_TYPE) {
+		cache->vector->visiting = 0;
+	} else if (
+		!*mutable
+		&& (cache->type == SEXPRESSION_TYPE || cache->type == QEXPRESSION_TYPE)
+	) {
+		cache->hash = hash;
+		cache->hashed = 1;
+	}
+	value_tasks_pop();
+	return hash;
+}
+
+/*
+Returns hash-consed value equal to expression or string `value`, which is
+freed if an equal value is consed already. Children are consed first. Values
+with children other than numbers and symbols are kept plain, because those
+may be mutable or guarded by optimization.
+*/
+static Value*
+value_hashcons(Value *value)
+{
+	size_t i;
+	unsigned char consable = 1;
+	Value *child,
+		*found;
+
+	if (value->refs || value->origin)
+		return value;
+
+	switch (value->type) {
+	case SEXPRESSION_TYPE: /* FALLTHROUGH */
+	case QEXPRESSION_TYPE:
+		for (i = 0; i < value->children_count; ++i) {
+			child = value->children[i] = value_hashcons(value->children[i]);
+			if (
+				!child->refs
+				&& (
+					child->origin
+					|| (child->type != NUMBER_TYPE && child->type != SYMBOL_TYPE)
+				)
+			)
+				consable = 0;
+		}
+		break;
+	case STRING_TYPE:
+		break;
+	default:
+		consable = 0;
+		break;
+	}
+	if (!consable)
+		return value;
+
+	value_hash(value);
+	found = hashcons_find(value);
+	if (found) {
+		value_free(value);
+		++found->refs;
+		return found;
+	}
+
+	/* Feedback shared with copies in arena can't leave it without them */
+	if (
+		value->type == SEXPRESSION_TYPE
+		&& value->site
+		&& value->site->refs > 1
+		&& pool_arena_contains(value->site)
+	) {
+		--value->site->refs;
+		value->site = NULL;
 	}
+
+	/* Consed value may outlive arena, so it's moved out at once */
+	value = value_promote(value);
+	value->refs = 1;
+	hashcons_insert(value);
+	return value;
 }
 
+/* Allocates closure over `env` with `args` formals and `body`. */
 static Value*
-value_lambda_alloc(Value *args, Value *body)
+value_lambda_alloc(Value *args, Value *body, Env *env)
 {
-	Value *value = malloc(sizeof(Value));
-	value->type = FUNCTION_TYPE;
-	value->env = env_alloc();
-	value->lambda_formals = args;
-	value->lambda_body = body;
+	Value *value = value_alloc(FUNCTION_TYPE);
+	value->env = env_copy(env);
+	value->lambda = pool_alloc(sizeof(ValueLambda));
+	value->lambda->refs = 1;
+	value->lambda->formals = args;
+	value->lambda->body = body;
+
+	/* Count formals before `&` */
+	value->lambda->required = 0;
+	while (
+		value->lambda->required < args->children_count
+		&& strcmp(args->children[value->lambda->required]->symbol, "&") != 0
+	)
+		++value->lambda->required;
+	value->lambda->variadic = value->lambda->required < args->children_count;
+	value->lambda_args = NULL;
 	value->builtin = NULL;
+	value->memo = NULL;
+	value->record_function = NULL;
 	return value;
 }
 
+/*
+Evaluates `body` in a new scope enclosed by `env`, so its `=` bindings don't
+leak to `env`.
+*/
+static Value*
+value_let_eval(const Value *body, Env *env)
+{
+	Env *frame = env_alloc(0);
+	Value *result;
+
+	frame->parent = env_copy(env);
+	result = value_sexpression_eval(body, frame);
+	value_frame_release(frame);
+	return result;
+}
+
+/* Moves shared code of lambda out of arena once. */
+static ValueLambda*
+value_lambda_promote(ValueLambda *lambda)
+{
+	ValueLambda *rv = pool_forward(lambda);
+
+	if (!rv) {
+		rv = pool_promote(lambda, sizeof(ValueLambda));
+		pool_forward_set(lambda, rv);
+		rv->formals = value_promote(rv->formals);
+		rv->body = value_promote(rv->body);
+	}
+	return rv;
+}
+
+/*
+Calls memoized function `f` with `count` arguments `args`. Returns cached
+result if arguments were seen before, otherwise calls wrapped lambda and
+caches the result unless it is an error.
+*/
+static Value*
+value_memo_call(Value *f, Env *env, Value **args, size_t count)
+{
+	size_t hash;
+	Value key,
+		*copy,
+		*result;
+
+	/* Look up arguments on the stack through a temporary expression */
+	key.type = SEXPRESSION_TYPE;
+	key.refs = 0;
+	key.children = args;
+	key.children_count = count;
+	key.site = NULL;
+	key.origin = NULL;
+	key.hashed = 0;
+	hash = value_hash(&key);
+	result = memo_get(f->memo, &key, hash);
+
+	if (!result) {
+		copy = value_copy(&key);
+		result = value_function_call(
+			value_copy(f->memo->function),
+			env,
+			args,
+			count
+		);
+		if (result->type == ERROR_TYPE) {
+			value_free(copy);
+		} else {
+			value_memo_escape(f->memo);
+			memo_put(f->memo, copy, hash, result);
+		}
+	} else {
+		value_args_free(args, count);
+	}
+
+	value_free(f);
+	return result;
+}
+
+/*
+Records cache `memo` to be filled by the current top level form once. Entries
+used since then are promoted when the outermost arena is left.
+*/
+static void
+value_memo_escape(Memo *memo)
+{
+	if (!memo->escaped) {
+		memo->escaped = 1;
+		memo->recent = 0;
+		value_escapes_push()->memo = memo_copy(memo);
+	}
+}
+
 static Value*
 value_number_alloc(ValueNumber number)
 {
-	Value *value = malloc(sizeof(Value));
-	value->type = NUMBER_TYPE;
+	Value *value = value_alloc(NUMBER_TYPE);
 	value->number = number;
 	return value;
 }
 
+/*
+Checks that number `value` is an integer a counter can hold exactly. Also
+rejects NaN.
+*/
+static unsigned char
+value_number_integer(const Value *value)
+{
+	return value->number >= -VALUE_COUNTER_MAX
+		&& value->number <= VALUE_COUNTER_MAX
+		&& value->number == (long long)value->number;
+}
+
 static Value*
 value_number_read(const mpc_ast_t *ast)
 {
 	double number;
-	errno = 0;
-	number = strtod(ast->contents, NULL);
-	if (errno == ERANGE)
+	if (!number_parse(ast->contents, &number))
 		return value_error_alloc("Invalid number: %s.", ast->contents);
 	return value_number_alloc(number);
 }
@@ -1004,13 +3505,14 @@ value_pop_child(Value *value, size_t child_i)
 	Value *child = value->children[child_i];
 
 	/* Shift memory */
-	memcpy(
+	memmove(
 		value->children + child_i,
 		value->children + child_i + 1,
 		sizeof(Value *) * (value->children_count - child_i - 1)
 	);
 
 	value->children_count--;
+	value->hashed = 0;
 
 	/* Fit memory */
 	value->children = realloc(
@@ -1020,75 +3522,472 @@ value_pop_child(Value *value, size_t child_i)
 	return child;
 }
 
+/*
+Prints `value`. Items of expressions and containers are printed by a loop.
+*/
+static void
+value_print(const Value *value)
+{
+	size_t base = value_tasks.count;
+	const Value *items;
+	ValueTask *task;
+
+	do {
+		value_print_node(value);
+
+		/* Take the next item or close the finished value */
+		value = NULL;
+		while (!value && value_tasks.count > base) {
+			task = &value_tasks.items[value_tasks.count - 1];
+			items = value_task_items(task);
+			if (task->index < value_items_count(items)) {
+				value_print_separator(task);
+				value = value_item(items, task->index++);
+			} else {
+				value_print_end(task);
+				value_tasks_pop();
+			}
+		}
+	} while (value);
+}
+
+static void
+value_print_node(const Value *value)
+{
+	switch (value->type) {
+	case ERROR_TYPE:
+		output_format("Error: %s", value->error);
+		break;
+	case FUNCTION_TYPE:
+		value_function_print(value);
+		break;
+	case NUMBER_TYPE:
+		output_number(value->number);
+		break;
+	case QEXPRESSION_TYPE: /* FALLTHROUGH*/
+	case SEXPRESSION_TYPE:
+		value_expression_print(value);
+		break;
+	case STRING_TYPE:
+		value_string_print(value);
+		break;
+	case SYMBOL_TYPE:
+		output_string(value->symbol);
+		break;
+	case VECTOR_TYPE:
+		value_vector_print(value);
+		break;
+	case PVECTOR_TYPE:
+		value_pvector_print(value);
+		break;
+	case MAP_TYPE:
+		value_map_print(value);
+		break;
+	case RECORD_TYPE:
+		value_record_print(value);
+		break;
+	}
+}
+
+/* Prints closing bracket of value of finished task. */
+static void
+value_print_end(const ValueTask *task)
+{
+	switch (task->value->type) {
+	case SEXPRESSION_TYPE:
+		output_char(')');
+		break;
+	case VECTOR_TYPE:
+		task->value->vector->visiting = 0;
+		/* FALLTHROUGH */
+	case PVECTOR_TYPE:
+		output_char(']');
+		break;
+	default:
+		output_char('}');
+		break;
+	}
+}
+
+/* Prints what precedes the next item of task. */
+static void
+value_print_separator(const ValueTask *task)
+{
+	const RecordType *type;
+
+	switch (task->value->type) {
+	case MAP_TYPE:
+		/* Entries are separated by comma, key and value by space */
+		if (task->index % 2)
+			output_char(' ');
+		else if (task->index > 0)
+			output_string(", ");
+		break;
+	case RECORD_TYPE:
+		/* Fields are preceded by their names and separated by comma */
+		type = task->value->record->type;
+		if (task->index > 0)
+			output_string(", ");
+		output_format("%s ", type->fields[task->index]);
+		break;
+	default:
+		if (task->index > 0)
+			output_char(' ');
+		break;
+	}
+}
+
+/*
+Moves what promoted `rv` refers to out of arena. Values it refers to are moved
+by nested calls of `value_promote`, which leave what they refer to for the
+loop.
+*/
 static void
-value_print(const Value *value)
+value_promote_node(Value *rv)
 {
-	switch (value->type) {
+	size_t i;
+
+	if (rv->origin)
+		rv->origin = value_promote(rv->origin);
+
+	switch (rv->type) {
 	case ERROR_TYPE:
-		printf("Error: %s", value->error);
+		rv->error = pool_strpromote(rv->error);
 		break;
 	case FUNCTION_TYPE:
-		value_function_print(value);
+		if (rv->memo) {
+			memo_promote(rv->memo);
+		} else if (!rv->builtin && !rv->record_function) {
+			rv->env = env_promote(rv->env);
+			rv->lambda = value_lambda_promote(rv->lambda);
+			if (rv->lambda_args)
+				rv->lambda_args = value_promote(rv->lambda_args);
+		}
 		break;
 	case NUMBER_TYPE:
-		printf("%f", value->number);
 		break;
-	case QEXPRESSION_TYPE: /* FALLTHROUGH*/
-	case SEXPRESSION_TYPE:
-		value_expression_print(value);
+	case SEXPRESSION_TYPE: /* FALLTHROUGH */
+	case QEXPRESSION_TYPE:
+		for (i = 0; i < rv->children_count; ++i)
+			rv->children[i] = value_promote(rv->children[i]);
+		if (rv->site)
+			rv->site = value_site_promote(rv->site);
 		break;
 	case STRING_TYPE:
-		value_string_print(value);
+		rv->string = pool_strpromote(rv->string);
 		break;
 	case SYMBOL_TYPE:
-		printf("%s", value->symbol);
+		rv->symbol = pool_strpromote(rv->symbol);
+		break;
+	case VECTOR_TYPE:
+		vector_promote(rv->vector);
+		break;
+	case PVECTOR_TYPE:
+		pvector_promote(rv->pvector);
+		break;
+	case MAP_TYPE:
+		hamt_promote(rv->map);
+		break;
+	case RECORD_TYPE:
+		rv->record = record_promote(rv->record);
 		break;
 	}
 }
 
+/*
+Evaluates condition of `select` clause `clause` at argument `index`. Returns
+value of the clause if condition is true or NULL if it isn't.
+*/
 static Value*
-value_sexpression_eval(Value *value, Env *env)
+value_select_clause(const Value *clause, size_t index, Env *env)
 {
-	size_t i;
-	Value *first_child,
-		*result;
+	Value *condition = value_clause_check("select", clause, index);
+
+	if (condition)
+		return condition;
+	condition = value_eval(clause->children[0], env);
+	if (condition->type == ERROR_TYPE)
+		return condition;
+	if (condition->type != NUMBER_TYPE) {
+		value_free(condition);
+		return value_error_alloc(
+			"select: Invalid %zu argument condition type. Expected %s.",
+			index,
+			value_type_names[NUMBER_TYPE]
+		);
+	}
 
-	/* Eval children and check errors of evaluation */
-	for (i = 0; i < value->children_count; ++i) {
-		value->children[i] = value_eval(value->children[i], env);
-		if (value->children[i]->type == ERROR_TYPE)
-			return value_free_without_child(value, i);
+	if (!condition->number) {
+		value_free(condition);
+		return NULL;
 	}
+	value_free(condition);
+	return value_eval(clause->children[1], env);
+}
+
+/*
+Evaluates children of expression `value` as sexpression without modifying
+them, so qexpression bodies are evaluated in place.
+*/
+static Value*
+value_sexpression_eval(const Value *value, Env *env)
+{
+	size_t i,
+		count,
+		first = 0;
+	ValueBuiltin builtin = NULL;
+	const Value *head;
+	Value **args,
+		*result;
+
+	/* Evaluate original code if globals it depends on were redefined */
+	if (value->origin && !value_guard_valid(value))
+		return value_eval(value->origin, env);
 
 	/* Check if there is no arguments */
 	if (value->children_count == 0)
-		return value;
+		return value_expression_alloc(SEXPRESSION_TYPE);
 	else if (value->children_count == 1)
-		return value_free_without_child(value, 0);
+		return value_eval(value->children[0], env);
+
+	/* Call builtin named by the head directly without a function value */
+	head = value->children[0];
+	if (
+		head->type == SYMBOL_TYPE
+		&& head->builtin
+		&& env_get_builtin(env, head)
+	) {
+		builtin = head->builtin;
+		if (builtin == value_symbol_if_eval)
+			return value_form_if(value, env);
+		else if (builtin == value_symbol_while_eval)
+			return value_form_while(value, env);
+		else if (builtin == value_symbol_for_eval)
+			return value_form_for(value, env, 0);
+		else if (builtin == value_symbol_dotimes_eval)
+			return value_form_for(value, env, 1);
+		else if (builtin == value_symbol_select_eval)
+			return value_form_select(value, env);
+		else if (builtin == value_symbol_case_eval)
+			return value_form_case(value, env);
+		else if (builtin == value_symbol_let_eval)
+			return value_form_let(value, env);
+		else if (
+			builtin == value_symbol_and_eval
+			|| builtin == value_symbol_or_eval
+		)
+			return value_form_condition_chain(
+				value,
+				env,
+				builtin == value_symbol_or_eval
+			);
+		first = 1;
+	}
+
+	/* Eval children to arguments on the stack and check errors of evaluation */
+	count = value->children_count - first;
+	args = value_stack_push(count);
+	for (i = 0; i < count; ++i) {
+		args[i] = value_eval(value->children[first + i], env);
+		if (args[i]->type == ERROR_TYPE) {
+			result = args[i];
+			value_args_free(args, i);
+			value_stack_pop(count);
+			return result;
+		}
+	}
 
-	/* Pop function */
-	first_child = value_pop_child(value, 0);
-	if (first_child->type != FUNCTION_TYPE) {
+	if (builtin && value->site) {
+		result = value_site_call(args, count, env, builtin, value->site);
+	} else if (builtin) {
+		result = builtin(args, count, env);
+	} else if (args[0]->type != FUNCTION_TYPE) {
 		result = value_error_alloc(
 			"()'s first child is not a function, but %s.",
-			value_type_names[first_child->type]
+			value_type_names[args[0]->type]
 		);
-		value_free(first_child);
-		value_free(value);
-		return result;
+		value_args_free(args, count);
+	} else {
+		/* Call function: fill env with arguments, etc. */
+		result = value_function_call(args[0], env, args + 1, count - 1);
+	}
+
+	value_stack_pop(count);
+	return result;
+}
+
+/*
+Calls `builtin` with `count` evaluated arguments `args` of call site with
+feedback `site`. Specialized site computes result of two numbers in place.
+*/
+static Value*
+value_site_call(
+	Value **args,
+	size_t count,
+	Env *env,
+	ValueBuiltin builtin,
+	ValueSite *site
+)
+{
+	Value *left,
+		*right;
+	unsigned char numbers = count == 2
+		&& args[0]->type == NUMBER_TYPE
+		&& args[1]->type == NUMBER_TYPE;
+
+	if (site->state == VALUE_SITE_UNINITIALIZED) {
+		/* Specialize on the first call */
+		site->state = numbers
+			? value_site_specialize(builtin)
+			: VALUE_SITE_GENERIC;
+	} else if (site->state != VALUE_SITE_GENERIC && !numbers) {
+		/* Guard failed, deoptimize and give up after too many attempts */
+		site->state = ++site->deopts < VALUE_SITE_MAX_DEOPTS
+			? VALUE_SITE_UNINITIALIZED
+			: VALUE_SITE_GENERIC;
+	}
+
+	if (!numbers)
+		return builtin(args, count, env);
+
+	left = args[0];
+	right = args[1];
+	switch (site->state) {
+	case VALUE_SITE_ADD:
+		left->number += right->number;
+		break;
+	case VALUE_SITE_SUBSTRACT:
+		left->number -= right->number;
+		break;
+	case VALUE_SITE_MULTIPLY:
+		left->number *= right->number;
+		break;
+	case VALUE_SITE_DIVIDE:
+		/* Let builtin report division by zero */
+		if (right->number == 0)
+			return builtin(args, count, env);
+		left->number /= right->number;
+		break;
+	case VALUE_SITE_EQ:
+		left->number = left->number == right->number;
+		break;
+	case VALUE_SITE_NE:
+		left->number = left->number != right->number;
+		break;
+	case VALUE_SITE_GT:
+		left->number = left->number > right->number;
+		break;
+	case VALUE_SITE_GE:
+		left->number = left->number >= right->number;
+		break;
+	case VALUE_SITE_LT:
+		left->number = left->number < right->number;
+		break;
+	case VALUE_SITE_LE:
+		left->number = left->number <= right->number;
+		break;
+	default:
+		return builtin(args, count, env);
+	}
+
+	/* Reuse the left argument for result */
+	value_free(right);
+	return left;
+}
+
+/* Returns specialized state of `builtin` applied to two numbers. */
+static ValueSiteState
+value_site_specialize(ValueBuiltin builtin)
+{
+	if (builtin == value_symbol_add_eval)
+		return VALUE_SITE_ADD;
+	else if (builtin == value_symbol_substract_eval)
+		return VALUE_SITE_SUBSTRACT;
+	else if (builtin == value_symbol_multiply_eval)
+		return VALUE_SITE_MULTIPLY;
+	else if (builtin == value_symbol_divide_eval)
+		return VALUE_SITE_DIVIDE;
+	else if (builtin == value_symbol_eq_eval)
+		return VALUE_SITE_EQ;
+	else if (builtin == value_symbol_ne_eval)
+		return VALUE_SITE_NE;
+	else if (builtin == value_symbol_gt_eval)
+		return VALUE_SITE_GT;
+	else if (builtin == value_symbol_ge_eval)
+		return VALUE_SITE_GE;
+	else if (builtin == value_symbol_lt_eval)
+		return VALUE_SITE_LT;
+	else if (builtin == value_symbol_le_eval)
+		return VALUE_SITE_LE;
+	return VALUE_SITE_GENERIC;
+}
+
+/* Moves shared call site out of arena once. */
+static ValueSite*
+value_site_promote(ValueSite *site)
+{
+	ValueSite *rv = pool_forward(site);
+
+	if (!rv) {
+		rv = pool_promote(site, sizeof(ValueSite));
+		pool_forward_set(site, rv);
+	}
+	return rv;
+}
+
+/* Reserves `count` contiguous slots for arguments of a call. */
+static Value**
+value_stack_push(size_t count)
+{
+	ValueStack *segment,
+		*next;
+
+	if (!value_stack || value_stack->top + count > value_stack->size) {
+		segment = value_stack ? value_stack->next : NULL;
+		if (!segment || segment->size < count) {
+			/* Next segments are empty, replace them by fitting one */
+			while (segment) {
+				next = segment->next;
+				free(segment);
+				segment = next;
+			}
+			segment = malloc(
+				sizeof(ValueStack)
+				+ sizeof(Value *) * (count > VALUE_STACK_SEGMENT_SIZE
+					? count
+					: VALUE_STACK_SEGMENT_SIZE)
+			);
+			segment->size = count > VALUE_STACK_SEGMENT_SIZE
+				? count
+				: VALUE_STACK_SEGMENT_SIZE;
+			segment->top = 0;
+			segment->next = NULL;
+			segment->previous = value_stack;
+			if (value_stack)
+				value_stack->next = segment;
+		}
+		value_stack = segment;
 	}
 
-	/* Call function: fill env with arguments, etc. */
-	return value_function_call(first_child, env, value);
+	value_stack->top += count;
+	return value_stack->values + value_stack->top - count;
+}
+
+/* Releases the last `count` reserved slots. */
+static void
+value_stack_pop(size_t count)
+{
+	value_stack->top -= count;
+	if (value_stack->top == 0 && value_stack->previous)
+		value_stack = value_stack->previous;
 }
 
 static void
 value_string_print(const Value *value)
 {
-	char *escaped = strdup(value->string);
-	escaped = mpcf_escape(escaped);
-	printf("\"%s\"", escaped);
-	free(escaped);
+	output_char('"');
+	output_escaped(value->string);
+	output_char('"');
 }
 
 static Value*
@@ -1103,11 +4002,19 @@ value_string_read(const mpc_ast_t *ast)
 	unescaped = mpcf_unescape(unescaped);
 	rv = value_string_alloc(unescaped);
 	free(unescaped);
+
+	if (hashcons_enabled)
+		return value_hashcons(rv);
 	return rv;
 }
 
 static Value*
-value_symbol_arithmetic_eval(const char *symbol, Value *value, const Env *env)
+value_symbol_arithmetic_eval(
+	const char *symbol,
+	Value **args,
+	size_t count,
+	const Env *env
+)
 {
 	(void)env;
 
@@ -1120,17 +4027,17 @@ value_symbol_arithmetic_eval(const char *symbol, Value *value, const Env *env)
 		divide = strcmp(symbol, "/") == 0;
 
 	/* Check that children are numbers */
-	for (i = 0; i < value->children_count; ++i)
-		VALIDATE_SYMBOL_ARG_TYPE(symbol, value, i, NUMBER_TYPE);
+	for (i = 0; i < count; ++i)
+		VALIDATE_SYMBOL_ARG_TYPE(symbol, args, count, i, NUMBER_TYPE);
 
-	left = value_pop_child(value, 0);
+	left = args[0];
 
 	/* Negative number */
-	if (substract && value->children_count == 0)
+	if (substract && count == 1)
 		left->number = -left->number;
 
-	while (value->children_count > 0) {
-		right = value_pop_child(value, 0);
+	for (i = 1; i < count; ++i) {
+		right = args[i];
 		if (add) {
 			left->number += right->number;
 		} else if (substract) {
@@ -1140,10 +4047,9 @@ value_symbol_arithmetic_eval(const char *symbol, Value *value, const Env *env)
 		} else if (divide) {
 			/* Check division by zero */
 			if (right->number == 0) {
-				value_free(right);
 				value_free(left);
-				left = value_error_alloc("Division by zero.");
-				break;
+				value_args_free(args + i, count - i);
+				return value_error_alloc("Division by zero.");
 			}
 
 			left->number /= right->number;
@@ -1152,20 +4058,24 @@ value_symbol_arithmetic_eval(const char *symbol, Value *value, const Env *env)
 		value_free(right);
 	}
 
-	value_free(value);
 	return left;
 }
 
 static Value*
-value_symbol_cmp_eval(const char *symbol, Value *value, const Env *env)
+value_symbol_cmp_eval(
+	const char *symbol,
+	Value **args,
+	size_t count,
+	const Env *env
+)
 {
 	(void)env;
 	unsigned char eq;
 
-	VALIDATE_SYMBOL_ARGS_COUNT(symbol, value, 2);
+	VALIDATE_SYMBOL_ARGS_COUNT(symbol, args, count, 2);
 
-	eq = value_eq(value->children[0], value->children[1]);
-	value_free(value);
+	eq = value_eq(args[0], args[1]);
+	value_args_free(args, count);
 	return value_number_alloc(strcmp(symbol, "==") == 0 ? eq : !eq);
 }
 
@@ -1173,7 +4083,8 @@ value_symbol_cmp_eval(const char *symbol, Value *value, const Env *env)
 static Value*
 value_symbol_condition_chain_eval(
 	const char *symbol,
-	Value *value,
+	Value **args,
+	size_t count,
 	const Env *env
 )
 {
@@ -1182,14 +4093,15 @@ value_symbol_condition_chain_eval(
 	size_t i;
 	unsigned char or = 0,
 		and = 0;
-	ValueNumber result;
+	ValueNumber result = 0;
 
 	VALIDATE_SYMBOL_ARGS(
-		value,
-		value->children_count >= 2,
+		args,
+		count,
+		count >= 2,
 		"%s: Too few arguments. Expected greater or equal to 2. Got %zu.",
 		symbol,
-		value->children_count
+		count
 	);
 
 	if (strcmp(symbol, "||") == 0)
@@ -1197,82 +4109,96 @@ value_symbol_condition_chain_eval(
 	else if (strcmp(symbol, "&&") == 0)
 		and = 1;
 
-	for (i = 0; i < value->children_count; ++i) {
-		VALIDATE_SYMBOL_ARG_TYPE(symbol, value, i, NUMBER_TYPE);
+	for (i = 0; i < count; ++i) {
+		VALIDATE_SYMBOL_ARG_TYPE(symbol, args, count, i, NUMBER_TYPE);
 
 		if (i == 0)
-			result = value->children[i]->number;
+			result = args[i]->number;
 		else if (or)
-			result = result || value->children[i]->number;
+			result = result || args[i]->number;
 		else if (and)
-			result = result && value->children[i]->number;
+			result = result && args[i]->number;
 
 		if ((!result && and) || (result && or))
 			break;
 	}
 
-	value_free(value);
+	value_args_free(args, count);
 	return value_number_alloc(result);
 }
 
 static Value*
-value_symbol_ordering_eval(const char *symbol, Value *value, const Env *env)
+value_symbol_ordering_eval(
+	const char *symbol,
+	Value **args,
+	size_t count,
+	const Env *env
+)
 {
 	(void)env;
 	ValueNumber result = 0;
 
-	VALIDATE_SYMBOL_ARGS_COUNT(symbol, value, 2);
-	VALIDATE_SYMBOL_ARG_TYPE(symbol, value, 0, NUMBER_TYPE);
-	VALIDATE_SYMBOL_ARG_TYPE(symbol, value, 1, NUMBER_TYPE);
+	VALIDATE_SYMBOL_ARGS_COUNT(symbol, args, count, 2);
+	VALIDATE_SYMBOL_ARG_TYPE(symbol, args, count, 0, NUMBER_TYPE);
+	VALIDATE_SYMBOL_ARG_TYPE(symbol, args, count, 1, NUMBER_TYPE);
 
 	if (strcmp(symbol, ">") == 0)
-		result = value->children[0]->number > value->children[1]->number;
+		result = args[0]->number > args[1]->number;
 	else if (strcmp(symbol, "<") == 0)
-		result = value->children[0]->number < value->children[1]->number;
+		result = args[0]->number < args[1]->number;
 	else if (strcmp(symbol, ">=") == 0)
-		result = value->children[0]->number >= value->children[1]->number;
+		result = args[0]->number >= args[1]->number;
 	else if (strcmp(symbol, "<=") == 0)
-		result = value->children[0]->number <= value->children[1]->number;
+		result = args[0]->number <= args[1]->number;
 
-	value_free(value);
+	value_args_free(args, count);
 	return value_number_alloc(result);
 }
 
 /*
-To set variable with `symbol` keyword to `env` with first child of `value`
-as formals list and other children of `value` as arguments.
+To set variable with `symbol` keyword to `env` with first of `args` as
+formals list and other `args` as values.
 */
 static Value*
-value_symbol_variable_eval(const char *symbol, Value *value, Env *env)
+value_symbol_variable_eval(
+	const char *symbol,
+	Value **args,
+	size_t count,
+	Env *env
+)
 {
 	size_t i;
 	Value *symbols;
 
 	VALIDATE_SYMBOL_ARGS(
-		value,
-		value->children_count >= 2,
+		args,
+		count,
+		count >= 2,
 		"%s: Required at least one value.",
 		symbol
 	);
 
-	symbols = value->children[0];
+	symbols = args[0];
 
 	VALIDATE_SYMBOL_ARGS(
-		value,
+		args,
+		count,
 		symbols->type == QEXPRESSION_TYPE,
 		"%s: Arguments not in {}.",
 		symbol
 	);
 	for (i = 0; i < symbols->children_count; ++i)
 		VALIDATE_SYMBOL_ARGS(
-			value,
+			args,
+			count,
 			symbols->children[i]->type == SYMBOL_TYPE,
 			"%s: Argument not a symbol.",
 			symbol
 		);
 	VALIDATE_SYMBOL_ARGS(
-		value,
-		symbols->children_count == value->children_count - 1,
+		args,
+		count,
+		symbols->children_count == count - 1,
 		"%s: Arguments count not equals to values count.",
 		symbol
 	);
@@ -1280,11 +4206,359 @@ value_symbol_variable_eval(const char *symbol, Value *value, Env *env)
 	/* Set value to key locally or globally */
 	for (i = 0; i < symbols->children_count; ++i) {
 		if (strcmp(symbol, "=") == 0)
-			env_set(env, symbols->children[i], value->children[i + 1]);
+			env_set(env, symbols->children[i], args[i + 1]);
 		else if (strcmp(symbol, "def") == 0)
-			env_set_for_ancestor(env, symbols->children[i], value->children[i + 1]);
+			env_set_for_ancestor(env, symbols->children[i], args[i + 1]);
 	}
 
-	value_free(value);
+	value_args_free(args, count);
 	return value_expression_alloc(SEXPRESSION_TYPE);
 }
+
+/* Value whose items are visited by `task`. */
+static const Value*
+value_task_items(const ValueTask *task)
+{
+	return task->value->type == MAP_TYPE ? task->target : task->value;
+}
+
+/* Doubles capacity of the task stack. */
+static void
+value_tasks_grow(void)
+{
+	value_tasks.capacity = value_tasks.capacity
+		? value_tasks.capacity * 2
+		: VALUE_TASKS_MIN_CAPACITY;
+	value_tasks.items = realloc(
+		value_tasks.items,
+		sizeof(ValueTask) * value_tasks.capacity
+	);
+}
+
+/* Pops task, freeing entries of map flattened for it. */
+static void
+value_tasks_pop(void)
+{
+	ValueTask *task = &value_tasks.items[--value_tasks.count];
+
+	if (task->value->type != MAP_TYPE)
+		return;
+	value_items_free(task->target);
+	if (task->other)
+		value_items_free((Value *)task->other);
+}
+
+/* Pushes task of `value` from its first child. Returns the task. */
+static ValueTask*
+value_tasks_push(const Value *value)
+{
+	ValueTask *task;
+
+	if (value_tasks.count == value_tasks.capacity)
+		value_tasks_grow();
+	task = &value_tasks.items[value_tasks.count++];
+	task->value = value;
+	task->target = NULL;
+	task->other = NULL;
+	task->index = 0;
+	return task;
+}
+
+/*
+Evaluates qexpression `body` while qexpression `condition` is true. Returns
+result of the last iteration.
+*/
+static Value*
+value_while_loop(const Value *condition, const Value *body, Env *env)
+{
+	Value *condition_result,
+		*result = value_expression_alloc(SEXPRESSION_TYPE);
+
+	while (1) {
+		condition_result = value_sexpression_eval(condition, env);
+		if (condition_result->type != NUMBER_TYPE) {
+			value_free(result);
+			result = value_error_alloc(
+				"while: Condition isn't a number, but %s.",
+				value_type_names[condition_result->type]
+			);
+			value_free(condition_result);
+			return result;
+		}
+		if (!condition_result->number) {
+			value_free(condition_result);
+			return result;
+		}
+		value_free(condition_result);
+
+		/* Free result of previous iteration */
+		value_free(result);
+		result = value_sexpression_eval(body, env);
+	}
+}
+
+/*
+Evaluates `for` arguments `code`: counter name, bounds and body. `dotimes`
+arguments if `times` is set have only upper bound. Counter is bound in a loop
+frame inside `env` and updated in place, so it isn't seen after the loop.
+Returns result of the last iteration or the first error.
+*/
+static Value*
+value_for_loop(const Value **code, Env *env, unsigned char times)
+{
+	size_t i,
+		count = times ? 3 : 4;
+	long long bounds[2] = {0, 0},
+		counter;
+	const char *symbol = times ? "dotimes" : "for";
+	Env *loop;
+	EnvEntry *entry;
+	Value *result;
+
+	if (
+		code[0]->type != QEXPRESSION_TYPE
+		|| code[0]->children_count != 1
+		|| code[0]->children[0]->type != SYMBOL_TYPE
+	)
+		return value_error_alloc("%s: Expected single symbol in {}.", symbol);
+	for (i = 1; i < count - 1; ++i) {
+		if (code[i]->type != NUMBER_TYPE)
+			return value_error_alloc(
+				"%s: Invalid %zu argument type. Expected %s. Got %s.",
+				symbol,
+				i,
+				value_type_names[NUMBER_TYPE],
+				value_type_names[code[i]->type]
+			);
+		if (!value_number_integer(code[i]))
+			return value_error_alloc("%s: Bounds must be integers.", symbol);
+		bounds[times ? 1 : i - 1] = (long long)code[i]->number;
+	}
+	if (code[count - 1]->type != QEXPRESSION_TYPE)
+		return value_error_alloc(
+			"%s: Invalid %zu argument type. Expected %s. Got %s.",
+			symbol,
+			count - 1,
+			value_type_names[QEXPRESSION_TYPE],
+			value_type_names[code[count - 1]->type]
+		);
+
+	result = value_expression_alloc(SEXPRESSION_TYPE);
+	if (bounds[0] >= bounds[1])
+		return result;
+
+	/* Entry stays in place even if the body rebinds the counter */
+	loop = env_alloc_loop(env);
+	entry = env_put(loop, code[0]->children[0], value_number_alloc(bounds[0]));
+	for (counter = bounds[0]; counter < bounds[1]; ++counter) {
+		if (entry->value->type == NUMBER_TYPE) {
+			entry->value->number = counter;
+		} else {
+			value_free(entry->value);
+			entry->value = value_number_alloc(counter);
+		}
+
+		/* Free result of previous iteration */
+		value_free(result);
+		result = value_sexpression_eval(code[count - 1], loop);
+		if (result->type == ERROR_TYPE)
+			break;
+	}
+	env_release(loop);
+	return result;
+}
+
+/* Checks that integer `index` is below `count`. */
+static unsigned char
+value_index_valid(const Value *index, size_t count)
+{
+	return index->number >= 0 && index->number < count;
+}
+
+/* Checks that `key` is immutable data, so its hash doesn't change. */
+static unsigned char
+value_map_key_valid(const Value *key)
+{
+	return key->type == NUMBER_TYPE
+		|| key->type == STRING_TYPE
+		|| key->type == SYMBOL_TYPE
+		|| key->type == QEXPRESSION_TYPE;
+}
+
+/*
+Adds value of entry and value of its key in other map to `ValueMapEq`. Clears
+`eq` if other map lacks the key.
+*/
+static void
+value_map_eq_visit(const Value *key, const Value *value, void *data)
+{
+	ValueMapEq *map_eq = data;
+	const Value *other;
+
+	if (!map_eq->eq)
+		return;
+	other = hamt_get(map_eq->other, key, value_hash(key));
+	if (!other) {
+		map_eq->eq = 0;
+		return;
+	}
+	map_eq->values->children[map_eq->values->children_count++] =
+		(Value *)value;
+	map_eq->other_values->children[map_eq->other_values->children_count++] =
+		(Value *)other;
+}
+
+/*
+Allocates qexpression of keys and values of entries of map `value` borrowed
+from it. It is freed by `value_items_free`.
+*/
+static Value*
+value_map_flatten(const Value *value)
+{
+	Value *rv = value_items_alloc(value->map->count * 2);
+
+	hamt_each(value->map, value_map_flatten_visit, rv);
+	return rv;
+}
+
+/* Adds key and value of entry to qexpression of borrowed items. */
+static void
+value_map_flatten_visit(const Value *key, const Value *value, void *data)
+{
+	Value *items = data;
+
+	items->children[items->children_count++] = (Value *)key;
+	items->children[items->children_count++] = (Value *)value;
+}
+
+/* Adds copy of `key` to qexpression of keys. */
+static void
+value_map_keys_visit(const Value *key, const Value *value, void *data)
+{
+	(void)value;
+	value_add_child(data, value_copy(key));
+}
+
+/* Prints opening bracket, entries are printed by the pushed task. */
+static void
+value_map_print(const Value *value)
+{
+	output_string("#{");
+	value_tasks_push(value)->target = value_map_flatten(value);
+}
+
+/* Prints opening bracket, items are printed by the pushed task. */
+static void
+value_pvector_print(const Value *value)
+{
+	output_string("#[");
+	value_tasks_push(value);
+}
+
+/* Records item `index` of `vector` changed by the current top level form. */
+static void
+value_vector_escape(Vector *vector, size_t index)
+{
+	if (vector->changed_from == vector->changed_to) {
+		vector->changed_from = index;
+		vector->changed_to = index + 1;
+		value_escapes_push()->vector = vector_copy(vector);
+	} else if (index < vector->changed_from) {
+		vector->changed_from = index;
+	} else if (index >= vector->changed_to) {
+		vector->changed_to = index + 1;
+	}
+}
+
+/* Prints opening bracket, items are printed by the pushed task. */
+static void
+value_vector_print(const Value *value)
+{
+	/* Vector reached from its own items is elided */
+	if (value->vector->visiting) {
+		output_string("[...]");
+		return;
+	}
+	value->vector->visiting = 1;
+	output_char('[');
+	value_tasks_push(value);
+}
+
+/*
+Calls `function` declared by `defrecord` with `count` arguments `args`.
+Accessor reads its field at fixed offset after checking type of the record.
+*/
+static Value*
+value_record_call(
+	const RecordFunction *function,
+	Value **args,
+	size_t count
+)
+{
+	Value *rv;
+
+	if (function->kind == RECORD_CONSTRUCTOR) {
+		VALIDATE_SYMBOL_ARGS_COUNT(
+			function->name,
+			args,
+			count,
+			function->type->fields_count
+		);
+		rv = value_alloc(RECORD_TYPE);
+		rv->record = record_alloc(function->type, args);
+		return rv;
+	}
+
+	VALIDATE_SYMBOL_ARGS_COUNT(function->name, args, count, 1);
+	if (function->kind == RECORD_PREDICATE) {
+		rv = value_number_alloc(
+			args[0]->type == RECORD_TYPE
+			&& args[0]->record->type == function->type
+		);
+	} else {
+		VALIDATE_SYMBOL_ARGS(
+			args,
+			count,
+			args[0]->type == RECORD_TYPE
+				&& args[0]->record->type == function->type,
+			"%s: Invalid 0 argument type. Expected %s. Got %s.",
+			function->name,
+			function->type->name,
+			args[0]->type == RECORD_TYPE
+				? args[0]->record->type->name
+				: value_type_names[args[0]->type]
+		);
+		rv = value_copy(args[0]->record->fields[function->field]);
+	}
+	value_free(args[0]);
+	return rv;
+}
+
+/* Defines globally function of `type` of `kind` under its name. */
+static void
+value_record_define(
+	Env *env,
+	RecordType *type,
+	RecordFunctionKind kind,
+	size_t field
+)
+{
+	Value *key,
+		*value = value_alloc(FUNCTION_TYPE);
+
+	value->builtin = NULL;
+	value->memo = NULL;
+	value->record_function = record_function_alloc(type, kind, field);
+	key = value_symbol_alloc(value->record_function->name);
+	env_set_for_ancestor(env, key, value);
+	value_free(key);
+	value_free(value);
+}
+
+/* Prints opening bracket, fields are printed by the pushed task. */
+static void
+value_record_print(const Value *value)
+{
+	output_format("#%s{", value->record->type->name);
+	value_tasks_push(value);
+}
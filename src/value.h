@@ -14,36 +14,116 @@ typedef enum {
 	STRING_TYPE,
 	QEXPRESSION_TYPE,
 	SYMBOL_TYPE,
+	VECTOR_TYPE,
+	PVECTOR_TYPE,
+	MAP_TYPE,
+	RECORD_TYPE,
 } ValueType;
 
 typedef struct Env Env;
+typedef struct EnvEntry EnvEntry;
+typedef struct Hamt Hamt;
+typedef struct Memo Memo;
+typedef struct Pvector Pvector;
+typedef struct Record Record;
+typedef struct RecordFunction RecordFunction;
 typedef struct Value Value;
-typedef Value *(*ValueBuiltin)(Value *, Env *);
+typedef struct ValueSite ValueSite;
+typedef struct Vector Vector;
+typedef Value *(*ValueBuiltin)(Value **, size_t, Env *);
+
+/* Code of lambda. Immutable and shared between copies of function value */
+typedef struct ValueLambda {
+	size_t refs;
+	Value *formals;
+	Value *body;
+
+	/* Count of formals before `&` and whether `&` is present */
+	size_t required;
+	unsigned char variadic;
+} ValueLambda;
 
 struct Value {
 	ValueType type;
 
-	/* Basic */
-	char *error;
-	ValueNumber number;
-	char *string;
-	char *symbol;
+	/*
+	Copies of hash-consed value. Consed value is immutable and shared by its
+	copies. Zero for plain value
+	*/
+	unsigned int refs;
+
+	/* Set once value is moved out of arena, so it isn't visited again */
+	unsigned char promoted;
+
+	/*
+	Structural hash of expression or string cached by `value_hash`. Copies
+	share it until they are changed
+	*/
+	unsigned char hashed;
+	size_t hash;
 
-	/* Functions */
-	Env *env;
-	Value *lambda_formals;
-	Value *lambda_body;
+	/* Builtin function. Symbol naming a builtin has it resolved at read time */
 	ValueBuiltin builtin;
 
-	/* Expressions */
-	size_t children_count;
-	Value **children;
+	/* Optimizations. Original code is evaluated if `guard` was redefined */
+	Value *origin;
+	EnvEntry *guard;
+	unsigned long guard_version;
+
+	/* Payload of `type` */
+	union {
+		/* Basic */
+		char *error;
+		ValueNumber number;
+		char *string;
+		struct {
+			char *symbol;
+			size_t slot;
+		};
+
+		/*
+		Functions other than builtins. Lambda is a closure over `env` where
+		it was created. Partially applied lambda keeps given arguments in
+		`lambda_args`. Functions declared by `defrecord` are
+		`record_function`
+		*/
+		struct {
+			Env *env;
+			ValueLambda *lambda;
+			Value *lambda_args;
+			Memo *memo;
+			RecordFunction *record_function;
+		};
+
+		/* Expressions. Type feedback of call site is shared between copies */
+		struct {
+			size_t children_count;
+			Value **children;
+			ValueSite *site;
+		};
+
+		/*
+		Containers. Items of vectors, tries of persistent vectors and maps
+		and fields of records are shared between copies
+		*/
+		Vector *vector;
+		Pvector *pvector;
+		Hamt *map;
+		Record *record;
+	};
 };
 
+void value_arena_begin(void);
+void value_arena_end(void);
+void value_arena_escape(EnvEntry *);
 Value *value_copy(const Value *);
-Value *value_eval(Value *, Env *);
+unsigned char value_eq(const Value *, const Value *);
+Value *value_eval(const Value *, Env *);
 void value_free(Value *);
+size_t value_hash(const Value *);
+Value *value_own(Value *);
 void value_println(const Value *);
+Value *value_promote(Value *);
 Value *value_read(const mpc_ast_t *);
 
 void value_add_child(Value *, Value *);
@@ -54,33 +134,62 @@ Value *value_builtin_alloc(ValueBuiltin);
 Value *value_string_alloc(const char *);
 Value *value_symbol_alloc(const char *);
 
-Value *value_symbol_add_eval(Value *, Env *);
-Value *value_symbol_and_eval(Value *, Env *);
-Value *value_symbol_def_eval(Value *, Env *);
-Value *value_symbol_divide_eval(Value *, Env *);
-Value *value_symbol_error_eval(Value *, Env *);
-Value *value_symbol_eval_eval(Value *, Env *);
-Value *value_symbol_eq_eval(Value *, Env *);
-Value *value_symbol_ge_eval(Value *, Env *);
-Value *value_symbol_gt_eval(Value *, Env *);
-Value *value_symbol_head_eval(Value *, Env *);
-Value *value_symbol_if_eval(Value *, Env *);
-Value *value_symbol_input_eval(Value *, Env *);
-Value *value_symbol_join_eval(Value *, Env *);
-Value *value_symbol_lambda_eval(Value *, Env *);
-Value *value_symbol_le_eval(Value *, Env *);
-Value *value_symbol_list_eval(Value *, Env *);
-Value *value_symbol_load_eval(Value *, Env *);
-Value *value_symbol_lt_eval(Value *, Env *);
-Value *value_symbol_multiply_eval(Value *, Env *);
-Value *value_symbol_ne_eval(Value *, Env *);
-Value *value_symbol_not_eval(Value *, Env *);
-Value *value_symbol_or_eval(Value *, Env *);
-Value *value_symbol_print_eval(Value *, Env *);
-Value *value_symbol_set_eval(Value *, Env *);
-Value *value_symbol_substract_eval(Value *, Env *);
-Value *value_symbol_tail_eval(Value *, Env *);
-Value *value_symbol_while_eval(Value *, Env *);
+Value *value_symbol_add_eval(Value **, size_t, Env *);
+Value *value_symbol_and_eval(Value **, size_t, Env *);
+Value *value_symbol_case_eval(Value **, size_t, Env *);
+Value *value_symbol_def_eval(Value **, size_t, Env *);
+Value *value_symbol_defrecord_eval(Value **, size_t, Env *);
+Value *value_symbol_divide_eval(Value **, size_t, Env *);
+Value *value_symbol_do_eval(Value **, size_t, Env *);
+Value *value_symbol_dotimes_eval(Value **, size_t, Env *);
+Value *value_symbol_error_eval(Value **, size_t, Env *);
+Value *value_symbol_eval_eval(Value **, size_t, Env *);
+Value *value_symbol_eq_eval(Value **, size_t, Env *);
+Value *value_symbol_for_eval(Value **, size_t, Env *);
+Value *value_symbol_ge_eval(Value **, size_t, Env *);
+Value *value_symbol_gt_eval(Value **, size_t, Env *);
+Value *value_symbol_head_eval(Value **, size_t, Env *);
+Value *value_symbol_if_eval(Value **, size_t, Env *);
+Value *value_symbol_input_eval(Value **, size_t, Env *);
+Value *value_symbol_join_eval(Value **, size_t, Env *);
+Value *value_symbol_lambda_eval(Value **, size_t, Env *);
+Value *value_symbol_le_eval(Value **, size_t, Env *);
+Value *value_symbol_let_eval(Value **, size_t, Env *);
+Value *value_symbol_list_eval(Value **, size_t, Env *);
+Value *value_symbol_load_eval(Value **, size_t, Env *);
+Value *value_symbol_lt_eval(Value **, size_t, Env *);
+Value *value_symbol_map_get_eval(Value **, size_t, Env *);
+Value *value_symbol_map_keys_eval(Value **, size_t, Env *);
+Value *value_symbol_map_new_eval(Value **, size_t, Env *);
+Value *value_symbol_map_put_eval(Value **, size_t, Env *);
+Value *value_symbol_map_remove_eval(Value **, size_t, Env *);
+Value *value_symbol_map_size_eval(Value **, size_t, Env *);
+Value *value_symbol_memo_eval(Value **, size_t, Env *);
+Value *value_symbol_memo_stats_eval(Value **, size_t, Env *);
+Value *value_symbol_multiply_eval(Value **, size_t, Env *);
+Value *value_symbol_ne_eval(Value **, size_t, Env *);
+Value *value_symbol_not_eval(Value **, size_t, Env *);
+Value *value_symbol_number_to_string_eval(Value **, size_t, Env *);
+Value *value_symbol_or_eval(Value **, size_t, Env *);
+Value *value_symbol_pack_eval(Value **, size_t, Env *);
+Value *value_symbol_print_eval(Value **, size_t, Env *);
+Value *value_symbol_pvec_eval(Value **, size_t, Env *);
+Value *value_symbol_pvec_assoc_eval(Value **, size_t, Env *);
+Value *value_symbol_pvec_concat_eval(Value **, size_t, Env *);
+Value *value_symbol_pvec_conj_eval(Value **, size_t, Env *);
+Value *value_symbol_pvec_len_eval(Value **, size_t, Env *);
+Value *value_symbol_pvec_nth_eval(Value **, size_t, Env *);
+Value *value_symbol_select_eval(Value **, size_t, Env *);
+Value *value_symbol_set_eval(Value **, size_t, Env *);
+Value *value_symbol_substract_eval(Value **, size_t, Env *);
+Value *value_symbol_tail_eval(Value **, size_t, Env *);
+Value *value_symbol_unpack_eval(Value **, size_t, Env *);
+Value *value_symbol_vector_eval(Value **, size_t, Env *);
+Value *value_symbol_vector_get_eval(Value **, size_t, Env *);
+Value *value_symbol_vector_len_eval(Value **, size_t, Env *);
+Value *value_symbol_vector_push_eval(Value **, size_t, Env *);
+Value *value_symbol_vector_set_eval(Value **, size_t, Env *);
+Value *value_symbol_while_eval(Value **, size_t, Env *);
 
 /* `grammar.h` globals */
 extern mpc_parser_t *Program;
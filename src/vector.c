@@ -0,0 +1,92 @@
+#include <stdlib.h>
+#include "config.h"
+#include "pool.h"
+#include "vector.h"
+
+/* Allocates empty vector with room for `capacity` items. */
+Vector*
+vector_alloc(size_t capacity)
+{
+	Vector *rv = malloc(sizeof(Vector));
+	rv->refs = 1;
+	rv->count = 0;
+	rv->capacity = capacity < VECTOR_MIN_CAPACITY
+		? VECTOR_MIN_CAPACITY
+		: capacity;
+	rv->items = malloc(sizeof(Value *) * rv->capacity);
+	rv->visiting = 0;
+	rv->comparing = 0;
+	rv->changed_from = 0;
+	rv->changed_to = 0;
+	return rv;
+}
+
+/* Shares vector with new owner. */
+Vector*
+vector_copy(Vector *vector)
+{
+	++vector->refs;
+	return vector;
+}
+
+void
+vector_free(Vector *vector)
+{
+	size_t i;
+
+	if (--vector->refs > 0)
+		return;
+
+	for (i = 0; i < vector->count; ++i)
+		value_free(vector->items[i]);
+	free(vector->items);
+	free(vector);
+}
+
+/* Moves items out of arena once. */
+void
+vector_promote(Vector *vector)
+{
+	size_t i;
+
+	if (pool_forward(vector))
+		return;
+	pool_forward_set(vector, vector);
+
+	for (i = 0; i < vector->count; ++i)
+		vector->items[i] = value_promote(vector->items[i]);
+}
+
+/* Moves items in the changed range out of arena and empties the range. */
+void
+vector_promote_changed(Vector *vector)
+{
+	size_t i;
+
+	for (i = vector->changed_from; i < vector->changed_to; ++i)
+		vector->items[i] = value_promote(vector->items[i]);
+	vector->changed_from = 0;
+	vector->changed_to = 0;
+}
+
+/* Appends `value` doubling capacity if needed. Takes ownership of `value`. */
+void
+vector_push(Vector *vector, Value *value)
+{
+	if (vector->count == vector->capacity) {
+		vector->capacity *= 2;
+		vector->items = realloc(
+			vector->items,
+			sizeof(Value *) * vector->capacity
+		);
+	}
+	vector->items[vector->count++] = value;
+}
+
+/* Replaces item at valid `index` with `value` and takes ownership of it. */
+void
+vector_set(Vector *vector, size_t index, Value *value)
+{
+	value_free(vector->items[index]);
+	vector->items[index] = value;
+}
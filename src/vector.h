@@ -0,0 +1,39 @@
+#ifndef _VECTOR_H
+#define _VECTOR_H
+
+#include <stdlib.h>
+#include "value.h"
+
+/*
+Growable array of values. Mutable and shared between copies of vector value,
+so updates through one copy are seen through others.
+*/
+typedef struct Vector {
+	size_t refs;
+	size_t count;
+	size_t capacity;
+	Value **items;
+
+	/* Set while vector is printed or hashed to cut cycles */
+	unsigned char visiting;
+
+	/* Count of comparisons in progress with vector on the left side */
+	size_t comparing;
+
+	/*
+	Range of items changed by the current top level form. Empty if vector
+	isn't recorded as changed
+	*/
+	size_t changed_from;
+	size_t changed_to;
+} Vector;
+
+Vector *vector_alloc(size_t);
+Vector *vector_copy(Vector *);
+void vector_free(Vector *);
+void vector_promote(Vector *);
+void vector_promote_changed(Vector *);
+void vector_push(Vector *, Value *);
+void vector_set(Vector *, size_t, Value *);
+
+#endif /* _VECTOR_H */
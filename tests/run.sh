@@ -0,0 +1,27 @@
+#!/bin/sh
+#
+# Runs every tests/*.clisp with ./clisp and compares its output with the .out
+# file of the same name. Arguments of the interpreter are read from the
+# "; args:" line of a test and a stack limit in kilobytes from "; stack:".
+
+status=0
+actual=$(mktemp)
+trap 'rm -f "$actual"' EXIT
+
+for test in tests/*.clisp; do
+	args=$(sed -n 's/^; args: //p' "$test")
+	stack=$(sed -n 's/^; stack: //p' "$test")
+	(
+		if [ -n "$stack" ]; then
+			ulimit -s "$stack"
+		fi
+		./clisp $args "$test"
+	) > "$actual" 2>&1
+	if diff -u "${test%.clisp}.out" "$actual"; then
+		echo "ok $test"
+	else
+		echo "FAIL $test"
+		status=1
+	fi
+done
+exit $status